@@ -0,0 +1,179 @@
+#include "AlignedBuffer.hpp"
+
+#include <bit>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/mman.h>
+
+namespace {
+
+constexpr size_t kAlignment = 64;
+constexpr size_t kHugePage = size_t{2} << 20;
+
+/**
+ * @brief What acquire actually hands out for "bytes": the next of four
+ * steps per power of two, at least a cache line, and whole huge pages once
+ * the block is big enough to be mapped for them.
+ */
+size_t class_size(size_t bytes) {
+    if(bytes <= kAlignment) {
+        return kAlignment;
+    }
+    const size_t power = std::bit_floor(bytes);
+    const size_t step = std::max(power / 4, kAlignment);
+    size_t size = (bytes + step - 1) / step * step;
+    if(size >= kHugePage) {
+        size = (size + kHugePage - 1) / kHugePage * kHugePage;
+    }
+    return size;
+}
+
+void* map_block(size_t size) {
+    if(size < kHugePage) {
+        void* block = std::aligned_alloc(kAlignment, size);
+        if(!block) {
+            throw std::bad_alloc();
+        }
+        return block;
+    }
+
+    // Over-map by a huge page and cut the ends off so the block starts on a
+    // 2 MB boundary, otherwise the first and last pages can never be huge
+    const size_t mapped = size + kHugePage;
+    void* raw = ::mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(raw == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+    const auto start = reinterpret_cast<uintptr_t>(raw);
+    const uintptr_t aligned = (start + kHugePage - 1) & ~(kHugePage - 1);
+    if(aligned > start) {
+        ::munmap(raw, aligned - start);
+    }
+    const size_t tail = start + mapped - (aligned + size);
+    if(tail > 0) {
+        ::munmap(reinterpret_cast<void*>(aligned + size), tail);
+    }
+
+    void* block = reinterpret_cast<void*>(aligned);
+    // Only a hint, without transparent huge pages it is plain 4 KB pages
+    ::madvise(block, size, MADV_HUGEPAGE);
+    return block;
+}
+
+void unmap_block(void* block, size_t size) {
+    if(size < kHugePage) {
+        std::free(block);
+    } else {
+        ::munmap(block, size);
+    }
+}
+
+/**
+ * @brief Free blocks by class size. One lock for all of them: a frame
+ * buffer is taken and given back a few times per frame, not per element.
+ */
+class Pool {
+public:
+    ~Pool() { trim(); }
+
+    void* acquire(size_t bytes) {
+        const size_t size = class_size(bytes);
+        {
+            std::lock_guard lock(m_mutex);
+            auto it = m_free.find(size);
+            if(it != m_free.end() && !it->second.empty()) {
+                void* block = it->second.back();
+                it->second.pop_back();
+                m_cached -= size;
+                return block;
+            }
+        }
+        return map_block(size);
+    }
+
+    void release(void* block, size_t bytes) noexcept {
+        const size_t size = class_size(bytes);
+        {
+            std::lock_guard lock(m_mutex);
+            if(m_cached + size <= m_limit) {
+                try {
+                    m_free[size].push_back(block);
+                    m_cached += size;
+                    return;
+                } catch(const std::bad_alloc&) {
+                    // No room to remember it, so it goes back to the system
+                }
+            }
+        }
+        unmap_block(block, size);
+    }
+
+    void trim() {
+        std::unordered_map<size_t, std::vector<void*>> blocks;
+        {
+            std::lock_guard lock(m_mutex);
+            blocks.swap(m_free);
+            m_cached = 0;
+        }
+        for(auto& [size, list] : blocks) {
+            for(void* block : list) {
+                unmap_block(block, size);
+            }
+        }
+    }
+
+    size_t cached_bytes() {
+        std::lock_guard lock(m_mutex);
+        return m_cached;
+    }
+
+    void set_limit(size_t bytes) {
+        std::lock_guard lock(m_mutex);
+        m_limit = bytes;
+    }
+
+private:
+    std::mutex m_mutex;
+    std::unordered_map<size_t, std::vector<void*>> m_free;
+    size_t m_cached = 0;
+    size_t m_limit = size_t{1} << 30;
+};
+
+Pool& pool() {
+    static Pool instance;
+    return instance;
+}
+
+} // namespace
+
+namespace buffer_pool {
+
+void* acquire(size_t bytes) {
+    return pool().acquire(bytes);
+}
+
+void release(void* block, size_t bytes) noexcept {
+    pool().release(block, bytes);
+}
+
+void trim() {
+    pool().trim();
+}
+
+size_t cached_bytes() {
+    return pool().cached_bytes();
+}
+
+void set_cache_limit(size_t bytes) {
+    pool().set_limit(bytes);
+    if(cached_bytes() > bytes) {
+        trim();
+    }
+}
+
+} // namespace buffer_pool
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <type_traits>
+#include <utility>
+
+/**
+ * 64-byte aligned buffers from a process-wide pool of size classes. Freed
+ * blocks go back to their class and the next request of that class gets one
+ * back, already faulted in and mapped, rather than a fresh mapping that has
+ * to fault every page again. Blocks of 2 MB and up are mmapped 2 MB aligned
+ * with MADV_HUGEPAGE, so a big frame costs a few TLB entries, not thousands.
+ *
+ * The classes are 4 steps per power of two, so a block is never more than
+ * 25% bigger than asked for.
+ */
+
+namespace buffer_pool {
+
+// A block of at least "bytes", 64-byte aligned. Throws std::bad_alloc
+void* acquire(size_t bytes);
+// Gives back a block from acquire(bytes), same "bytes"
+void release(void* block, size_t bytes) noexcept;
+
+// Frees every cached block, e.g. after a burst of unusually big frames
+void trim();
+// Bytes held in free blocks, waiting to be reused
+size_t cached_bytes();
+
+// Upper bound on cached_bytes(), past it freed blocks are unmapped instead.
+// 1 GB by default
+void set_cache_limit(size_t bytes);
+
+} // namespace buffer_pool
+
+/**
+ * @brief An RAII, move-only array of T from buffer_pool. The contents start
+ * uninitialized, like new T[size]. Converts to std::span, so it can be
+ * passed straight to the _into kernels.
+ */
+template <class T>
+class AlignedBuffer {
+    static_assert(std::is_trivially_copyable_v<T> && std::is_trivially_destructible_v<T>,
+                  "AlignedBuffer holds raw samples");
+
+public:
+    AlignedBuffer() = default;
+    explicit AlignedBuffer(size_t size)
+        : m_data(size ? static_cast<T*>(buffer_pool::acquire(size * sizeof(T))) : nullptr), m_size(size) {}
+
+    ~AlignedBuffer() { reset(); }
+
+    AlignedBuffer(AlignedBuffer&& other) noexcept
+        : m_data(std::exchange(other.m_data, nullptr)), m_size(std::exchange(other.m_size, 0)) {}
+
+    AlignedBuffer& operator=(AlignedBuffer&& other) noexcept {
+        if(this != &other) {
+            reset();
+            m_data = std::exchange(other.m_data, nullptr);
+            m_size = std::exchange(other.m_size, 0);
+        }
+        return *this;
+    }
+
+    AlignedBuffer(const AlignedBuffer&) = delete;
+    AlignedBuffer& operator=(const AlignedBuffer&) = delete;
+
+    T* data() { return m_data; }
+    const T* data() const { return m_data; }
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+    T& operator[](size_t i) { return m_data[i]; }
+    const T& operator[](size_t i) const { return m_data[i]; }
+
+    T* begin() { return m_data; }
+    T* end() { return m_data + m_size; }
+    const T* begin() const { return m_data; }
+    const T* end() const { return m_data + m_size; }
+
+    operator std::span<T>() { return {m_data, m_size}; }
+    operator std::span<const T>() const { return {m_data, m_size}; }
+
+    // Back to the pool, leaving the buffer empty
+    void reset() {
+        if(m_data) {
+            buffer_pool::release(m_data, m_size * sizeof(T));
+        }
+        m_data = nullptr;
+        m_size = 0;
+    }
+
+private:
+    T* m_data = nullptr;
+    size_t m_size = 0;
+};
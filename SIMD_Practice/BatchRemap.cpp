@@ -0,0 +1,254 @@
+#include "BatchRemap.hpp"
+#include "Sum.hpp"
+#include "FileHandle.hpp"
+#include "Stopwatch.hpp"
+#include "Trace.hpp"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+
+namespace {
+
+using sum_detail::FileHandle;
+using sum_detail::throw_errno;
+
+// Per-frame spans of the I/O stages, the compute stage is the remap's own
+const trace::Region g_traceRead("batch_read");
+const trace::Region g_traceWrite("batch_write");
+
+// Grows a slot's buffer when a frame is bigger than any before it, the old
+// one goes back to the pool for the next caller
+template <class T>
+T* reserve(AlignedBuffer<T>& buffer, size_t count) {
+    if(count > buffer.size()) {
+        buffer = AlignedBuffer<T>(count);
+    }
+    return buffer.data();
+}
+
+// One frame in flight
+struct Slot {
+    size_t job;
+    size_t count;
+    AlignedBuffer<float> in;
+    AlignedBuffer<float> outFloat;
+    AlignedBuffer<uint8_t> outU8;
+};
+
+constexpr size_t kStop = std::numeric_limits<size_t>::max();
+
+/**
+ * @brief Hands slot indices from one stage to the next. pop blocks until a
+ * slot arrives, and returns kStop once the queue is closed and drained.
+ */
+class SlotQueue {
+public:
+    void push(size_t slot) {
+        {
+            std::lock_guard lock(m_mutex);
+            m_slots.push_back(slot);
+        }
+        m_ready.notify_one();
+    }
+
+    size_t pop() {
+        std::unique_lock lock(m_mutex);
+        m_ready.wait(lock, [&] { return !m_slots.empty() || m_closed; });
+        if(m_slots.empty()) {
+            return kStop;
+        }
+        const size_t slot = m_slots.front();
+        m_slots.pop_front();
+        return slot;
+    }
+
+    void close() {
+        {
+            std::lock_guard lock(m_mutex);
+            m_closed = true;
+        }
+        m_ready.notify_all();
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_ready;
+    std::deque<size_t> m_slots;
+    bool m_closed = false;
+};
+
+// pread/pwrite until done, they may return short on large requests
+void read_all(int fd, void* buffer, size_t bytes, const std::string& path) {
+    auto* p = static_cast<char*>(buffer);
+    for(size_t done = 0; done < bytes;) {
+        const ssize_t n = ::pread(fd, p + done, bytes - done, static_cast<off_t>(done));
+        if(n < 0 && errno == EINTR) {
+            continue;
+        }
+        if(n <= 0) {
+            if(n == 0) {
+                throw std::runtime_error(path + " shrank while it was being read");
+            }
+            throw_errno("pread " + path);
+        }
+        done += static_cast<size_t>(n);
+    }
+}
+
+void write_all(int fd, const void* buffer, size_t bytes, const std::string& path) {
+    const auto* p = static_cast<const char*>(buffer);
+    for(size_t done = 0; done < bytes;) {
+        const ssize_t n = ::pwrite(fd, p + done, bytes - done, static_cast<off_t>(done));
+        if(n < 0 && errno == EINTR) {
+            continue;
+        }
+        if(n < 0) {
+            throw_errno("pwrite " + path);
+        }
+        done += static_cast<size_t>(n);
+    }
+}
+
+} // namespace
+
+BatchRemapReport batch_remap_files(std::span<const BatchRemapJob> jobs, const BatchRemapOptions& options) {
+    const size_t depth = std::max<size_t>(options.depth, 1);
+    std::vector<Slot> slots(depth);
+
+    // free -> reader -> filled -> compute -> remapped -> writer -> free
+    SlotQueue freeSlots, filled, remapped;
+    for(size_t i = 0; i < depth; i++) {
+        freeSlots.push(i);
+    }
+
+    // The first failure wins and shuts every stage down
+    std::mutex errorMutex;
+    std::exception_ptr error;
+    const auto fail = [&] {
+        {
+            std::lock_guard lock(errorMutex);
+            if(!error) {
+                error = std::current_exception();
+            }
+        }
+        freeSlots.close();
+        filled.close();
+        remapped.close();
+    };
+
+    BatchRemapReport report{};
+    Stopwatch wall;
+    wall.start();
+
+    std::thread reader([&] {
+        Stopwatch busy;
+        try {
+            for(size_t job = 0; job < jobs.size(); job++) {
+                const size_t slot = freeSlots.pop();
+                if(slot == kStop) {
+                    break;
+                }
+
+                busy.start();
+                trace::Span span(g_traceRead);
+                const std::string& path = jobs[job].inPath;
+                FileHandle in(path, O_RDONLY);
+                struct stat st;
+                if(::fstat(in.fd(), &st) != 0) {
+                    throw_errno("fstat " + path);
+                }
+                const size_t bytes = static_cast<size_t>(st.st_size);
+                if(bytes % sizeof(float) != 0) {
+                    throw std::runtime_error(path + " is not a whole number of floats");
+                }
+
+                Slot& s = slots[slot];
+                s.job = job;
+                s.count = bytes / sizeof(float);
+                read_all(in.fd(), reserve(s.in, s.count), bytes, path);
+                report.bytesRead += bytes;
+                busy.stop();
+                report.read.busySeconds += busy.elapsed();
+
+                filled.push(slot);
+            }
+            filled.close();
+        } catch(...) {
+            fail();
+        }
+    });
+
+    std::thread writer([&] {
+        Stopwatch busy;
+        try {
+            for(size_t slot; (slot = remapped.pop()) != kStop;) {
+                busy.start();
+                trace::Span span(g_traceWrite);
+                const Slot& s = slots[slot];
+                const std::string& path = jobs[s.job].outPath;
+                FileHandle out(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                if(options.format == StreamOutput::UInt8) {
+                    write_all(out.fd(), s.outU8.data(), s.count, path);
+                    report.bytesWritten += s.count;
+                } else {
+                    write_all(out.fd(), s.outFloat.data(), s.count * sizeof(float), path);
+                    report.bytesWritten += s.count * sizeof(float);
+                }
+                busy.stop();
+                report.write.busySeconds += busy.elapsed();
+                report.frames++;
+
+                freeSlots.push(slot);
+            }
+        } catch(...) {
+            fail();
+        }
+    });
+
+    // The remap runs here so it keeps the caller's OpenMP team
+    Stopwatch busy;
+    try {
+        for(size_t slot; (slot = filled.pop()) != kStop;) {
+            busy.start();
+            Slot& s = slots[slot];
+            const std::span<const float> in(s.in.data(), s.count);
+            if(options.format == StreamOutput::UInt8) {
+                remap_avx2_xsimd_u8_into(in, {reserve(s.outU8, s.count), s.count}, options.dmin, options.mmult,
+                                         options.accuracy);
+            } else {
+                remap_avx2_xsimd_into(in, {reserve(s.outFloat, s.count), s.count}, options.dmin, options.mmult,
+                                      options.accuracy);
+            }
+            busy.stop();
+            report.compute.busySeconds += busy.elapsed();
+
+            remapped.push(slot);
+        }
+        remapped.close();
+    } catch(...) {
+        fail();
+    }
+
+    reader.join();
+    writer.join();
+    if(error) {
+        std::rethrow_exception(error);
+    }
+
+    wall.stop();
+    report.wallSeconds = wall.elapsed();
+    for(StageOccupancy* stage : {&report.read, &report.compute, &report.write}) {
+        stage->occupancy = report.wallSeconds > 0.0 ? stage->busySeconds / report.wallSeconds : 0.0;
+    }
+
+    return report;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <string>
+
+#include "StreamRemap.hpp"
+#include "SumTypes.hpp"
+
+/**
+ * Remaps many frame files, each raw native-endian floats, with reading,
+ * remapping and writing overlapped: while frame N is remapped on the OpenMP
+ * team, a reader thread preads frame N+1 and a writer thread writes frame
+ * N-1. Frames move through a small ring of 64-byte aligned buffers that are
+ * reused for the whole batch, so steady state allocates nothing.
+ */
+
+struct BatchRemapJob {
+    std::string inPath;
+    std::string outPath;
+};
+
+struct BatchRemapOptions {
+    int dmin;
+    int mmult;
+    StreamOutput format = StreamOutput::UInt8;
+    // Frames in flight at once, one buffer pair each. 3 is enough for one
+    // frame per stage, more smooths out uneven file sizes
+    size_t depth = 3;
+    Log10Accuracy accuracy = Log10Accuracy::Exact;
+};
+
+// How busy one stage was, waiting on the other stages does not count
+struct StageOccupancy {
+    double busySeconds;
+    // busySeconds over the wall time of the batch. The stage closest to 1 is
+    // the bottleneck
+    double occupancy;
+};
+
+struct BatchRemapReport {
+    size_t frames;
+    size_t bytesRead;
+    size_t bytesWritten;
+    double wallSeconds;
+    StageOccupancy read;
+    StageOccupancy compute;
+    StageOccupancy write;
+};
+
+// Throws std::system_error on the first file that cannot be read or written,
+// and std::runtime_error for an input that is not a whole number of floats.
+// Frames before the failing one have been written
+BatchRemapReport batch_remap_files(std::span<const BatchRemapJob> jobs, const BatchRemapOptions& options);
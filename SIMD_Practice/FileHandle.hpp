@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cerrno>
+#include <string>
+#include <system_error>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+/**
+ * File plumbing shared by the file-driven remaps (StreamRemap, BatchRemap).
+ * Internal, not part of the public API.
+ */
+namespace sum_detail {
+
+[[noreturn]] inline void throw_errno(const std::string& what) {
+    throw std::system_error(errno, std::generic_category(), what);
+}
+
+// Owns a file descriptor
+class FileHandle {
+public:
+    FileHandle(const std::string& path, int flags, mode_t mode = 0) : m_fd(::open(path.c_str(), flags, mode)) {
+        if(m_fd < 0) {
+            throw_errno("open " + path);
+        }
+    }
+
+    ~FileHandle() { ::close(m_fd); }
+
+    FileHandle(const FileHandle&) = delete;
+    FileHandle& operator=(const FileHandle&) = delete;
+
+    int fd() const { return m_fd; }
+
+private:
+    int m_fd;
+};
+
+} // namespace sum_detail
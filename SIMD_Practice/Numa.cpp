@@ -0,0 +1,193 @@
+#include "Numa.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include <omp.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <linux/mempolicy.h>
+
+namespace {
+
+// "0-3,8-11" to {0, 1, 2, 3, 8, 9, 10, 11}
+std::vector<int> parse_cpulist(const std::string& list) {
+    std::vector<int> cpus;
+    std::stringstream ss(list);
+    std::string range;
+    while(std::getline(ss, range, ',')) {
+        if(range.empty() || range == "\n") {
+            continue;
+        }
+        const size_t dash = range.find('-');
+        const int first = std::stoi(range.substr(0, dash));
+        const int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+        for(int cpu = first; cpu <= last; cpu++) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+NumaTopology read_topology() {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+
+    NumaTopology topology;
+    for(int node = 0;; node++) {
+        std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        if(!file) {
+            break;
+        }
+        std::string list;
+        std::getline(file, list);
+
+        // Only the CPUs this process may use, taskset and cgroups still apply
+        std::vector<int> cpus;
+        for(int cpu : parse_cpulist(list)) {
+            if(CPU_ISSET(cpu, &allowed)) {
+                cpus.push_back(cpu);
+            }
+        }
+        if(!cpus.empty()) {
+            topology.nodeCpus.push_back(std::move(cpus));
+        }
+    }
+
+    if(topology.nodeCpus.empty()) {
+        std::vector<int> cpus;
+        for(int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if(CPU_ISSET(cpu, &allowed)) {
+                cpus.push_back(cpu);
+            }
+        }
+        topology.nodeCpus.push_back(std::move(cpus));
+    }
+
+    return topology;
+}
+
+// The caller's affinity from before the first pin, what numa_unpin_omp_threads
+// goes back to
+const cpu_set_t& original_affinity() {
+    static const cpu_set_t mask = [] {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        sched_getaffinity(0, sizeof(set), &set);
+        return set;
+    }();
+    return mask;
+}
+
+} // namespace
+
+const NumaTopology& numa_topology() {
+    static const NumaTopology topology = read_topology();
+    return topology;
+}
+
+void numa_pin_omp_threads(int node) {
+    const auto& nodes = numa_topology().nodeCpus;
+    original_affinity();
+
+    #pragma omp parallel
+    {
+        const size_t team = omp_get_num_threads();
+        const size_t self = omp_get_thread_num();
+        const size_t target = node >= 0 ? static_cast<size_t>(node) % nodes.size() : self * nodes.size() / team;
+
+        // The whole socket rather than one core, the scheduler can still
+        // balance within it
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for(int cpu : nodes[target]) {
+            CPU_SET(cpu, &set);
+        }
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+}
+
+void numa_unpin_omp_threads() {
+    const cpu_set_t& set = original_affinity();
+
+    #pragma omp parallel
+    {
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+}
+
+void numa_first_touch(void* data, size_t bytes) {
+    auto* p = static_cast<volatile char*>(data);
+    const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+
+    // Same contiguous split of the buffer as the kernels' schedule(static)
+    #pragma omp parallel
+    {
+        const size_t team = omp_get_num_threads();
+        const size_t self = omp_get_thread_num();
+        const size_t first = self * bytes / team;
+        const size_t last = (self + 1) * bytes / team;
+
+        for(size_t i = first; i < last; i = (i / pageSize + 1) * pageSize) {
+            p[i] = 0;
+        }
+    }
+}
+
+void numa_place(void* data, size_t bytes) {
+    const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    constexpr size_t kHugePage = size_t{2} << 20;
+
+    // Only pages wholly inside the buffer, a small block shares its first and
+    // last pages with whatever the heap put next to it
+    const auto start = reinterpret_cast<uintptr_t>(data);
+    const uintptr_t begin = (start + pageSize - 1) / pageSize * pageSize;
+    const uintptr_t end = (start + bytes) / pageSize * pageSize;
+    if(end <= begin) {
+        return;
+    }
+
+    #pragma omp parallel
+    {
+        const size_t team = omp_get_num_threads();
+        const size_t self = omp_get_thread_num();
+
+        // Same contiguous split as the kernels' schedule(static), in whole
+        // pages. In huge pages once every thread's share is at least one, so
+        // moving a share does not split the pool's transparent huge pages
+        const size_t grain = bytes / team >= kHugePage ? kHugePage : pageSize;
+        const auto edge = [&](size_t t) {
+            if(t == team) {
+                return end;
+            }
+            const uintptr_t at = (start + t * bytes / team + grain - 1) / grain * grain;
+            return std::clamp(at, begin, end);
+        };
+        const uintptr_t first = edge(self);
+        const uintptr_t last = edge(self + 1);
+
+        unsigned cpu = 0;
+        unsigned node = 0;
+        if(last > first && syscall(SYS_getcpu, &cpu, &node, nullptr) == 0) {
+            unsigned long mask[16] = {};
+            mask[node / 64] |= 1ul << (node % 64);
+            const long moved = syscall(SYS_mbind, first, last - first, MPOL_PREFERRED, mask, sizeof(mask) * 8,
+                                       MPOL_MF_MOVE);
+            // Without mbind (seccomp, an old kernel) first touch is all there
+            // is, which only places pages nobody has touched yet
+            if(moved != 0) {
+                auto* p = reinterpret_cast<volatile char*>(first);
+                for(uintptr_t i = 0; i < last - first; i += pageSize) {
+                    p[i] = p[i];
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * NUMA placement for the large-frame kernels, from the topology in sysfs so
+ * there is no libnuma dependency. Two things decide where a kernel's memory
+ * traffic goes on a multi-socket host:
+ *
+ * - Which node a page lives on, fixed by the thread that first writes it.
+ *   numa_first_touch writes each page from the OpenMP thread that the
+ *   kernels' static schedule will later give it to.
+ * - Which socket each OpenMP thread runs on. numa_pin_omp_threads spreads
+ *   the team over the nodes in order, thread t of n on node t * nodes / n,
+ *   which lines the static partition up with the first touch.
+ */
+
+struct NumaTopology {
+    // The CPUs of each node with any, in node order. A host without NUMA
+    // information in sysfs is one node with every CPU we may run on
+    std::vector<std::vector<int>> nodeCpus;
+};
+
+const NumaTopology& numa_topology();
+
+// Pins each thread of the OpenMP team to the CPUs of one node, spread as
+// above, or every thread to "node" when it is not negative. libgomp keeps its
+// threads between parallel regions, so this holds for the regions that
+// follow with the same team size. Thread 0 is the calling thread, and threads
+// it starts while pinned inherit its node, so unpin when done
+void numa_pin_omp_threads(int node = -1);
+
+// Puts the team, the calling thread included, back on the CPUs the caller
+// had before the first pin. Call it from the thread that pinned
+void numa_unpin_omp_threads();
+
+// Writes one byte of each page of a fresh allocation from the thread that
+// the static partition gives that part of the buffer. Anything already there
+// is lost, call it before filling the buffer
+void numa_first_touch(void* data, size_t bytes);
+
+// Moves the pages of a buffer that may already be in use, like a block the
+// buffer pool hands back, to the node of the thread the static partition
+// gives them to, and makes that node preferred for them from then on. The
+// contents are kept. Falls back to numa_first_touch's placement where the
+// kernel does not allow mbind
+void numa_place(void* data, size_t bytes);
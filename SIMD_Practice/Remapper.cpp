@@ -0,0 +1,45 @@
+#include "Remapper.hpp"
+#include "SumKernels.hpp"
+#include "Trace.hpp"
+
+#include <cassert> // assert macro
+
+namespace {
+
+const trace::Region g_traceFrame("remapper_frame");
+
+} // namespace
+
+template <class Out, class Remap, class Fused>
+void Remapper::remap_frame(std::span<const float> in, std::span<Out> out, Remap remap, Fused fused) {
+    assert(in.size() == out.size());
+    if(in.empty()) {
+        return;
+    }
+
+    trace::Span span(g_traceFrame);
+    const auto& kernels = sum_detail::active_kernels();
+    const auto [dmin, mmult, mode, smoothing, accuracy] = m_options;
+
+    if(mode == RemapMode::Exact || !m_primed) {
+        // Two passes, this frame's own mean
+        const double frameMean = kernels.sum_avx2_xsimd_omp(in.data(), in.size()) / in.size();
+        (kernels.*remap)(in.data(), out.data(), in.size(), frameMean, dmin, mmult, accuracy);
+        m_mean = frameMean;
+        m_primed = true;
+        return;
+    }
+
+    // One pass, the history's mean in and this frame's |x| out
+    const double frameMean = (kernels.*fused)(in.data(), out.data(), in.size(), m_mean, dmin, mmult, accuracy) /
+                             in.size();
+    m_mean += smoothing * (frameMean - m_mean);
+}
+
+void Remapper::remap(std::span<const float> in, std::span<float> out) {
+    remap_frame(in, out, &sum_detail::KernelTable::remap_with_mean, &sum_detail::KernelTable::remap_fused);
+}
+
+void Remapper::remap_u8(std::span<const float> in, std::span<uint8_t> out) {
+    remap_frame(in, out, &sum_detail::KernelTable::remap_with_mean_u8, &sum_detail::KernelTable::remap_fused_u8);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include "SumTypes.hpp"
+
+/**
+ * A remap for frame streams that carries the clip level from frame to frame.
+ *
+ * The free remap functions read every frame twice, once for mean(|x|) and
+ * once to remap it. In Temporal mode a Remapper remaps each frame with the
+ * exponentially smoothed mean of the frames before it, and sums this frame's
+ * |x| in the same pass, so each frame is read once. The first frame after
+ * construction or reset() has no history and is remapped exactly.
+ *
+ * Exact mode is the two-pass remap_avx2_xsimd, for stills or when the scene
+ * changes too fast for the smoothing to keep up.
+ */
+
+enum class RemapMode {
+    Exact,
+    Temporal
+};
+
+struct RemapperOptions {
+    int dmin;
+    int mmult;
+    RemapMode mode = RemapMode::Temporal;
+    // Weight of the newest frame in the smoothed mean, in (0, 1]. 1 uses the
+    // previous frame's mean as is, smaller values ride out flicker
+    double smoothing = 0.25;
+    Log10Accuracy accuracy = Log10Accuracy::Exact;
+};
+
+class Remapper {
+public:
+    explicit Remapper(const RemapperOptions& options) : m_options(options) {}
+
+    // out must be the same size as in and may alias it
+    void remap(std::span<const float> in, std::span<float> out);
+    void remap_u8(std::span<const float> in, std::span<uint8_t> out);
+
+    // Forget the history, the next frame is remapped exactly
+    void reset() { m_primed = false; }
+
+    // The smoothed mean(|x|) the next frame will be remapped with, and the
+    // clip level C_L = 0.8 * mean that comes from it
+    double mean() const { return m_mean; }
+    float clip_low() const { return 0.8f * m_mean; }
+
+    const RemapperOptions& options() const { return m_options; }
+
+private:
+    template <class Out, class Remap, class Fused>
+    void remap_frame(std::span<const float> in, std::span<Out> out, Remap remap, Fused fused);
+
+    RemapperOptions m_options;
+    double m_mean = 0.0;
+    bool m_primed = false;
+};
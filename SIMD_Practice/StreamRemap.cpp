@@ -0,0 +1,116 @@
+#include "StreamRemap.hpp"
+#include "Sum.hpp"
+#include "FileHandle.hpp"
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+using sum_detail::FileHandle;
+using sum_detail::throw_errno;
+
+const trace::Region g_traceTile("stream_tile");
+
+/**
+ * @brief One tile's window of a file. Unmapping at the end of the tile is
+ * what bounds resident memory: the pages leave the process and, for the
+ * output, are left to writeback.
+ */
+class MappedWindow {
+public:
+    MappedWindow(int fd, size_t offset, size_t length, bool writable, int advice) : m_length(length) {
+        const int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+        m_addr = ::mmap(nullptr, length, prot, MAP_SHARED, fd, static_cast<off_t>(offset));
+        if(m_addr == MAP_FAILED) {
+            throw_errno("mmap");
+        }
+        // Only a hint, a kernel that ignores it just reads ahead less
+        ::madvise(m_addr, length, advice);
+    }
+
+    ~MappedWindow() { ::munmap(m_addr, m_length); }
+
+    MappedWindow(const MappedWindow&) = delete;
+    MappedWindow& operator=(const MappedWindow&) = delete;
+
+    template <class T>
+    std::span<T> as(size_t count) const { return {static_cast<T*>(m_addr), count}; }
+
+    // Starts writeback of the window without waiting for it
+    void flush_async() const { ::msync(m_addr, m_length, MS_ASYNC); }
+
+private:
+    void* m_addr;
+    size_t m_length;
+};
+
+} // namespace
+
+StreamRemapResult stream_remap_file(const std::string& inPath, const std::string& outPath, StreamOutput format,
+                                    const StreamRemapOptions& options) {
+    FileHandle in(inPath, O_RDONLY);
+
+    struct stat st;
+    if(::fstat(in.fd(), &st) != 0) {
+        throw_errno("fstat " + inPath);
+    }
+    const size_t inBytes = static_cast<size_t>(st.st_size);
+    if(inBytes % sizeof(float) != 0) {
+        throw std::runtime_error(inPath + " is not a whole number of floats");
+    }
+    const size_t count = inBytes / sizeof(float);
+
+    const size_t outElementBytes = format == StreamOutput::UInt8 ? sizeof(uint8_t) : sizeof(float);
+    FileHandle out(outPath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(::ftruncate(out.fd(), static_cast<off_t>(count * outElementBytes)) != 0) {
+        throw_errno("ftruncate " + outPath);
+    }
+
+    // A multiple of the page size in elements keeps both the input offset
+    // (4 bytes an element) and the output offset (1 or 4) on page boundaries
+    const size_t pageSize = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    const size_t budgetElements = options.tileBytes / (sizeof(float) + outElementBytes);
+    const size_t tileElements = std::max(pageSize, budgetElements - budgetElements % pageSize);
+
+    StreamRemapResult result{count, 0.0, 0};
+    if(count == 0) {
+        return result;
+    }
+
+    // Pass one, the mean magnitude of the whole frame
+    double absSum = 0.0;
+    for(size_t first = 0; first < count; first += tileElements) {
+        const size_t n = std::min(tileElements, count - first);
+        MappedWindow tile(in.fd(), first * sizeof(float), n * sizeof(float), false, MADV_SEQUENTIAL);
+        absSum += _sum_avx2_xsimd_omp(tile.as<float>(n).data(), n);
+    }
+    result.mean = absSum / count;
+
+    // Pass two, remap tile by tile into the output file
+    for(size_t first = 0; first < count; first += tileElements) {
+        const size_t n = std::min(tileElements, count - first);
+        trace::Span span(g_traceTile);
+        MappedWindow src(in.fd(), first * sizeof(float), n * sizeof(float), false, MADV_SEQUENTIAL);
+        MappedWindow dst(out.fd(), first * outElementBytes, n * outElementBytes, true, MADV_SEQUENTIAL);
+
+        if(format == StreamOutput::UInt8) {
+            remap_avx2_xsimd_u8_with_mean_into(src.as<const float>(n), dst.as<uint8_t>(n), result.mean,
+                                               options.dmin, options.mmult, options.accuracy);
+        } else {
+            remap_avx2_xsimd_with_mean_into(src.as<const float>(n), dst.as<float>(n), result.mean,
+                                            options.dmin, options.mmult, options.accuracy);
+        }
+        dst.flush_async();
+        result.tiles++;
+    }
+
+    return result;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include "SumTypes.hpp"
+
+/**
+ * Remaps a frame stored as raw native-endian floats in a file, for mosaics too
+ * big to hold in memory (let alone twice, input and output). The input is
+ * mmapped a tile at a time: one pass sums |x| for the global mean, a second
+ * remaps each tile into the matching window of the mmapped output file. Every
+ * window is unmapped and dropped from the process as soon as it is done, so
+ * resident memory stays around tileBytes whatever the size of the frame.
+ */
+
+enum class StreamOutput {
+    Float32,
+    UInt8
+};
+
+struct StreamRemapOptions {
+    int dmin;
+    int mmult;
+    // Input plus output bytes mapped at once. Rounded down to whole pages,
+    // and up to at least one page of elements
+    size_t tileBytes = size_t{64} << 20;
+    Log10Accuracy accuracy = Log10Accuracy::Exact;
+};
+
+struct StreamRemapResult {
+    size_t count;
+    double mean;
+    size_t tiles;
+};
+
+// Throws std::system_error if a file cannot be opened, sized or mapped, and
+// std::runtime_error if the input is not a whole number of floats. The output
+// file is created or truncated. The result matches remap_avx2_xsimd_into (or
+// its u8 version) on the whole frame up to the order the mean was summed in
+StreamRemapResult stream_remap_file(const std::string& inPath, const std::string& outPath, StreamOutput format,
+                                    const StreamRemapOptions& options);
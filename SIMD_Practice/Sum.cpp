@@ -1,268 +1,430 @@
 #include "Sum.hpp"
-#include <immintrin.h>
-#include <algorithm> // std::clamp
-#include <cmath> // std::log10
-#include <vector>
-#include <iostream>
-#include <new> // std::align_val_t
-#include <cstddef> // std::size_t
-
-#include <xsimd/xsimd.hpp>
-
-float hsum256_ps(__m256 v) {
-    __m128 vlow  = _mm256_castps256_ps128(v);          // low 128
-    __m128 vhigh = _mm256_extractf128_ps(v, 1);       // high 128
-    __m128 sum128 = _mm_add_ps(vlow, vhigh);          // add low + high
-    sum128 = _mm_hadd_ps(sum128, sum128);             // horizontal add
-    sum128 = _mm_hadd_ps(sum128, sum128);
-    return _mm_cvtss_f32(sum128);                     // extract final sum
-}
-
-double hsum256_pd(__m256d v) {
-    // Extract the high 128-bit lane
-    __m128d vhigh = _mm256_extractf128_pd(v, 1); // upper 2 doubles
-    // Extract the low 128-bit lane
-    __m128d vlow  = _mm256_castpd256_pd128(v);   // lower 2 doubles
-    // Add the two 128-bit halves
-    __m128d sum128 = _mm_add_pd(vlow, vhigh);
-    // Horizontal add the two doubles in sum128
-    sum128 = _mm_hadd_pd(sum128, sum128);
-    // Extract final scalar
-    return _mm_cvtsd_f64(sum128);
-}
-
-double _sum_avx2(float* __restrict__ data, size_t dataSize) {
-    __m256d vsum = _mm256_setzero_pd();
-    size_t i = 0;
-    for(; i + 8 <= dataSize; i += 8) {
-        __m256 v = _mm256_loadu_ps(&data[i]);
-        __m128 vlow  = _mm256_castps256_ps128(v);
-        __m128 vhigh = _mm256_extractf128_ps(v, 1);
-        __m256d sum0 = _mm256_cvtps_pd(vlow);   // convert first 4 to double
-        __m256d sum1 = _mm256_cvtps_pd(vhigh);  // convert next 4 to double
-        vsum = _mm256_add_pd(vsum, sum0);
-        vsum = _mm256_add_pd(vsum, sum1);
+#include "SumKernels.hpp"
+#include "Numa.hpp"
+#include "Trace.hpp"
+#include <bit> // std::countr_zero
+#include <cassert> // assert macro
+#include <cstdio> // std::fputs
+#include <cstdlib> // std::getenv, std::abort
+#include <cstring> // std::strcmp
+#include <stdexcept> // std::invalid_argument
+
+namespace sum_detail {
+
+bool isa_supported(Isa isa) {
+    __builtin_cpu_init();
+
+    switch(isa) {
+    case Isa::AVX512:
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+               __builtin_cpu_supports("avx512dq") && __builtin_cpu_supports("avx512vl") &&
+               __builtin_cpu_supports("fma") && __builtin_cpu_supports("f16c");
+    case Isa::AVX2:
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") &&
+               __builtin_cpu_supports("f16c");
+    case Isa::SSE42:
+        return __builtin_cpu_supports("sse4.2");
     }
 
-    double sum = hsum256_pd(vsum);
+    return false;
+}
 
-    for(; i < dataSize; i++) {
-        sum += data[i];
+const KernelTable& kernels_for(Isa isa) {
+    switch(isa) {
+    case Isa::AVX512:
+        return avx512_kernels;
+    case Isa::AVX2:
+        return avx2_kernels;
+    case Isa::SSE42:
+        break;
     }
 
-    return sum;
-} 
+    return sse42_kernels;
+}
 
 /**
- * @brief Computes the sum of "data" using OpenMP and
- * AVX2 vector instructions
- * 
- * @param data The buffer which we are summing over
- * @param n The size of the buffer
- * @return double 
+ * @brief Picks the widest kernel build the CPU supports. Setting SUM_ISA to
+ * "sse4.2" or "avx2" caps the choice, which is handy for comparing builds
+ * on the same box. There is no build below SSE4.2, so a CPU without it
+ * stops here rather than on the first kernel call.
  */
-double _sum_avx2_omp(float* __restrict__ data, size_t n) {
-    double total = 0.0;
-
-    #pragma omp parallel for reduction(+:total)
-    for (size_t i = 0; i < n; i += 8) {
-        __m256 v = _mm256_loadu_ps(&data[i]);
-
-        __m128 vlow  = _mm256_castps256_ps128(v);
-        __m128 vhigh = _mm256_extractf128_ps(v, 1);
-
-        __m256d sum0 = _mm256_cvtps_pd(vlow);   // convert first 4 floats to double
-        __m256d sum1 = _mm256_cvtps_pd(vhigh);  // convert next 4 floats to double
-
-        // horizontal sum of this chunk
-        __m128d hi0 = _mm256_extractf128_pd(sum0, 1);
-        __m128d lo0 = _mm256_castpd256_pd128(sum0);
-        
-        __m128d hi1 = _mm256_extractf128_pd(sum1, 1);
-        __m128d lo1 = _mm256_castpd256_pd128(sum1);
-        
-        auto sum2 = _mm_add_pd(lo0, hi0);
-        double thread_sum = _mm_cvtsd_f64(_mm_hadd_pd(sum2, sum2));
-        auto sum3 = _mm_add_pd(lo1, hi1);
-        thread_sum += _mm_cvtsd_f64(_mm_hadd_pd(sum3, sum3));
-
-        // accumulate to total (OpenMP handles reduction)
-        total += thread_sum;
+static const KernelTable& select_kernels() {
+    if(!isa_supported(Isa::SSE42)) {
+        std::fputs("libsum: this CPU lacks SSE4.2, the oldest instruction set libsum is built for\n", stderr);
+        std::abort();
     }
 
-    // handle tail elements
-    size_t remainder = n % 8;
-    for (size_t i = n - remainder; i < n; ++i)
-        total += data[i];
+    Isa best = Isa::SSE42;
+    if(isa_supported(Isa::AVX512)) {
+        best = Isa::AVX512;
+    } else if(isa_supported(Isa::AVX2)) {
+        best = Isa::AVX2;
+    }
 
-    return total;
+    if(const char* cap = std::getenv("SUM_ISA")) {
+        if(std::strcmp(cap, "sse4.2") == 0) {
+            best = Isa::SSE42;
+        } else if(std::strcmp(cap, "avx2") == 0 && best == Isa::AVX512) {
+            best = Isa::AVX2;
+        }
+    }
+
+    return kernels_for(best);
 }
 
-double _sum_avx2_xsimd_omp(float* __restrict__ data, size_t dataSize) {
-    constexpr size_t simdWidth = xsimd::batch<float>::size; // AVX2 floats
-    
-    double total = 0.0;
-
-    #pragma omp parallel reduction(+:total)
-    {
-        xsimd::batch<double> localBatch1(0.f);
-        xsimd::batch<double> localBatch2(0.f);
-
-        #pragma omp for nowait schedule(static)
-        for(size_t i = 0; i < dataSize - dataSize % simdWidth; i+= simdWidth) {
-            auto v = xsimd::load_aligned(&data[i]);
-            auto converted = xsimd::widen(v);
-
-            localBatch1 += xsimd::abs(converted[0]);
-            localBatch2 += xsimd::abs(converted[1]);
-        }
+// Resolved once while the library is loaded, the entry points below are then a
+// single indirect call.
+static const KernelTable* const g_kernels = &select_kernels();
+
+const KernelTable& active_kernels() {
+    return *g_kernels;
+}
+
+} // namespace sum_detail
+
+using sum_detail::g_kernels;
 
-        total += (xsimd::reduce_add(localBatch1) + xsimd::reduce_add(localBatch2));
+const char* sum_active_isa() {
+    return g_kernels->name;
+}
+
+// Per-call spans of the entry points frame loops use, see Trace.hpp
+static const trace::Region g_traceSum("sum");
+static const trace::Region g_traceRemap("remap");
+static const trace::Region g_traceRemapU8("remap_u8");
+
+static bool g_numaAware = false;
+
+void sum_set_numa_aware(bool enabled) {
+    if(enabled) {
+        numa_pin_omp_threads();
+    } else if(g_numaAware) {
+        numa_unpin_omp_threads();
     }
+    g_numaAware = enabled;
+}
 
-    for(size_t i = dataSize - dataSize % simdWidth; i < dataSize; i++) {
-        total += std::abs(data[i]);
+// The output goes to the nodes of the threads that will write it. A block
+// from the pool may have been faulted in by any thread, for a frame of any
+// size, so its pages are moved rather than only first touched
+static void place_output(void* data, size_t bytes) {
+    if(g_numaAware) {
+        numa_place(data, bytes);
     }
+}
+
+double _sum_avx2(float* __restrict__ data, size_t dataSize) {
+    return g_kernels->sum_avx2(data, dataSize);
+}
 
-    return total;
+double _sum_avx2_omp(float* __restrict__ data, size_t dataSize) {
+    return g_kernels->sum_avx2_omp(data, dataSize);
 }
 
-float* _remap(float *data, int dmin, int mmult, const int rows, const int cols) {
-    double mean = 0.0;
-    const size_t size = rows * cols;
-    #pragma omp parallel for reduction(+:mean)
-    for(size_t i = 0; i < size; i++) {
-        mean += std::abs(data[i]);
+double _sum_avx2_xsimd_omp(float* __restrict__ data, size_t dataSize) {
+    trace::Span span(g_traceSum);
+    return g_kernels->sum_avx2_xsimd_omp(data, dataSize);
+}
+
+double _sum_avx2_xsimd_omp(const std::complex<float>* data, size_t dataSize) {
+    return g_kernels->complex_samples.sum_xsimd(data, dataSize);
+}
+
+double _sum_avx2_xsimd_omp(const int16_t* data, size_t dataSize) {
+    return g_kernels->int16_samples.sum_xsimd(data, dataSize);
+}
+
+double _sum_avx2_omp(const Float16* data, size_t dataSize) {
+    return g_kernels->sum_float16(data, dataSize);
+}
+
+double _sum_avx2_omp(const BFloat16* data, size_t dataSize) {
+    return g_kernels->sum_bfloat16(data, dataSize);
+}
+
+double _sum_avx2_xsimd_omp(const Float16* data, size_t dataSize) {
+    return g_kernels->float16_samples.sum_xsimd(data, dataSize);
+}
+
+double _sum_avx2_xsimd_omp(const BFloat16* data, size_t dataSize) {
+    return g_kernels->bfloat16_samples.sum_xsimd(data, dataSize);
+}
+
+double _sum_deterministic(std::span<const float> data) {
+    return g_kernels->sum_deterministic(data.data(), data.size());
+}
+
+double _sum_squares(std::span<const float> data) {
+    return g_kernels->sum_squares(data.data(), data.size());
+}
+
+double _dot(std::span<const float> a, std::span<const float> b) {
+    assert(a.size() == b.size());
+    return g_kernels->dot(a.data(), b.data(), a.size());
+}
+
+FrameStats reduce_stats(std::span<const float> data) {
+    return g_kernels->reduce_stats(data.data(), data.size());
+}
+
+void reduce_rows(std::span<const float> data, size_t rows, size_t cols, std::span<double> out, AxisStat stat) {
+    assert(data.size() == rows * cols && out.size() == rows);
+    g_kernels->reduce_rows(data.data(), rows, cols, out.data());
+    if(stat == AxisStat::Mean && cols > 0) {
+        for(double& x : out) {
+            x /= cols;
+        }
     }
-    mean /= size;
-
-    const float C_L = 0.8f * mean;
-    const float C_H = mmult * C_L;
-    (void)C_H;
-    const float slope = (255 - dmin) / std::log10(C_L);
-    const float constant = dmin - (slope * std::log10(C_L));
-    std::cout << "The slope is " << slope << " and the constant is " << constant << "\n";
-
-    float *remappedData = new float[size];
-    const float EPS = 1e-5f;
-
-    #pragma omp parallel for collapse(2)
-    for(int i = 0; i < rows; i++) {
-        for(int j = 0; j < cols; j++) {
-            const auto remappedVal = slope * std::log10(std::max(std::abs(data[i * cols + j]), EPS)) + constant;
-            if(remappedVal > 255) {
-                remappedData[i * cols + j] = 255;
-            } else if(remappedVal < 0) {
-                remappedData[i * cols + j] = 0;
-            } else {
-                remappedData[i * cols + j] = remappedVal;
-            }
+}
+
+void reduce_cols(std::span<const float> data, size_t rows, size_t cols, std::span<double> out, AxisStat stat) {
+    assert(data.size() == rows * cols && out.size() == cols);
+    g_kernels->reduce_cols(data.data(), rows, cols, out.data());
+    if(stat == AxisStat::Mean && rows > 0) {
+        for(double& x : out) {
+            x /= rows;
         }
     }
+}
 
+AlignedBuffer<float> _remap(float *data, int dmin, int mmult, const int rows, const int cols) {
+    const size_t size = rows * cols;
+    AlignedBuffer<float> remappedData(size);
+    place_output(remappedData.data(), size * sizeof(float));
+    g_kernels->remap(data, remappedData.data(), size, dmin, mmult);
     return remappedData;
 }
 
-float* remap_avx2_scalar_log10(const float* data, int dmin, int mmult, const int rows, const int cols) 
-{
-    double mean = 0.0;
+AlignedBuffer<float> remap_avx2_scalar_log10(const float* data, int dmin, int mmult, const int rows, const int cols) {
     const size_t size = rows * cols;
-    #pragma omp parallel for reduction(+:mean)
-    for(size_t i = 0; i < size; i++) {
-        mean += std::abs(data[i]);
-    }
-    mean /= size;
+    AlignedBuffer<float> remappedData(size);
+    place_output(remappedData.data(), size * sizeof(float));
+    g_kernels->remap_avx2_scalar_log10(data, remappedData.data(), size, dmin, mmult);
+    return remappedData;
+}
+
+AlignedBuffer<float> remap_avx2_xsimd(const float* data, int dmin, int mmult, const int rows, const int cols,
+                                      Log10Accuracy accuracy) {
+    const size_t size = rows * cols;
+    trace::Span span(g_traceRemap);
+    AlignedBuffer<float> remappedData(size);
+    place_output(remappedData.data(), size * sizeof(float));
+    g_kernels->remap_avx2_xsimd(data, remappedData.data(), size, dmin, mmult, accuracy);
+    return remappedData;
+}
 
-    const float C_L = 0.8f * mean;
-    const float C_H = mmult * C_L;
-    (void)C_H;
-    const float slope = (255 - dmin) / std::log10(C_L);
-    const float constant = dmin - (slope * std::log10(C_L));
+AlignedBuffer<uint8_t> remap_avx2_xsimd_u8(const float* data, int dmin, int mmult, const int rows, const int cols,
+                                           Log10Accuracy accuracy) {
+    const size_t size = rows * cols;
+    trace::Span span(g_traceRemapU8);
+    AlignedBuffer<uint8_t> remappedData(size);
+    place_output(remappedData.data(), size);
+    g_kernels->remap_avx2_xsimd_u8(data, remappedData.data(), size, dmin, mmult, accuracy);
+    return remappedData;
+}
 
-    float *remappedData = new float[size];
-    const float EPS = 1e-5f;
+AlignedBuffer<float> remap_avx2_xsimd_lut(const float* data, int dmin, int mmult, const int rows, const int cols,
+                                          LutRemapInfo* info) {
+    const size_t size = rows * cols;
+    AlignedBuffer<float> remappedData(size);
+    place_output(remappedData.data(), size * sizeof(float));
+    g_kernels->remap_avx2_xsimd_lut(data, remappedData.data(), size, dmin, mmult, info);
+    return remappedData;
+}
 
-    size_t simdWidth = 8; // AVX2 floats
-    size_t total = rows * cols;
+AlignedBuffer<float> remap_percentile(const float* data, int dmin, int mmult, const int rows, const int cols,
+                                      float lowPercentile, float highPercentile, ClipLevels* levels,
+                                      Log10Accuracy accuracy) {
+    const size_t size = rows * cols;
+    AlignedBuffer<float> remappedData(size);
+    place_output(remappedData.data(), size * sizeof(float));
+    g_kernels->remap_percentile(data, remappedData.data(), size, dmin, mmult, lowPercentile, highPercentile,
+                                levels, accuracy);
+    return remappedData;
+}
 
-    #pragma omp parallel for
-    for (size_t i = 0; i < total; i += simdWidth) {
-        __m256 v = _mm256_loadu_ps(data + i);
+void _remap_into(std::span<const float> in, std::span<float> out, int dmin, int mmult) {
+    assert(in.size() == out.size());
+    g_kernels->remap(in.data(), out.data(), in.size(), dmin, mmult);
+}
 
-        // vectorized abs and max(EPS)
-        __m256 vabs  = _mm256_max_ps(_mm256_andnot_ps(_mm256_set1_ps(-0.f), v),
-                                     _mm256_set1_ps(EPS));
+void remap_avx2_scalar_log10_into(std::span<const float> in, std::span<float> out, int dmin, int mmult) {
+    assert(in.size() == out.size());
+    g_kernels->remap_avx2_scalar_log10(in.data(), out.data(), in.size(), dmin, mmult);
+}
 
-        // extract elements to scalar for log10
-        std::vector<float> temp(simdWidth, 0.f);
-        _mm256_storeu_ps(temp.data(), vabs);  // store the processed values to temp array
+void remap_avx2_xsimd_into(std::span<const float> in, std::span<float> out, int dmin, int mmult,
+                           Log10Accuracy accuracy) {
+    assert(in.size() == out.size());
+    trace::Span span(g_traceRemap);
+    g_kernels->remap_avx2_xsimd(in.data(), out.data(), in.size(), dmin, mmult, accuracy);
+}
 
-        for (size_t j = 0; j < simdWidth; j++) {
-            temp[j] = slope * std::log10(temp[j]) + constant;
-        }
+void remap_avx2_xsimd_u8_into(std::span<const float> in, std::span<uint8_t> out, int dmin, int mmult,
+                              Log10Accuracy accuracy) {
+    assert(in.size() == out.size());
+    trace::Span span(g_traceRemapU8);
+    g_kernels->remap_avx2_xsimd_u8(in.data(), out.data(), in.size(), dmin, mmult, accuracy);
+}
 
-        // vectorize clamp
-        __m256 vremap = _mm256_loadu_ps(temp.data());
-        __m256 vclamp = _mm256_min_ps(_mm256_max_ps(vremap, _mm256_set1_ps(0.f)),
-                                      _mm256_set1_ps(255.f));
+void remap_avx2_xsimd_lut_into(std::span<const float> in, std::span<float> out, int dmin, int mmult,
+                               LutRemapInfo* info) {
+    assert(in.size() == out.size());
+    g_kernels->remap_avx2_xsimd_lut(in.data(), out.data(), in.size(), dmin, mmult, info);
+}
 
-        _mm256_storeu_ps(remappedData + i, vclamp);
-    }
+void remap_percentile_into(std::span<const float> in, std::span<float> out, int dmin, int mmult,
+                           float lowPercentile, float highPercentile, ClipLevels* levels,
+                           Log10Accuracy accuracy) {
+    assert(in.size() == out.size());
+    g_kernels->remap_percentile(in.data(), out.data(), in.size(), dmin, mmult, lowPercentile,
+                                highPercentile, levels, accuracy);
+}
 
-    // tail loop for remaining elements
-    for (size_t i = (total / simdWidth) * simdWidth; i < total; i++) {
-        float val = slope * std::log10(std::max(std::abs(data[i]), EPS)) + constant;
-        remappedData[i] = std::clamp(val, 0.f, 255.f);
-    }
+void remap_avx2_xsimd_with_mean_into(std::span<const float> in, std::span<float> out, double mean, int dmin,
+                                     int mmult, Log10Accuracy accuracy) {
+    assert(in.size() == out.size());
+    g_kernels->remap_with_mean(in.data(), out.data(), in.size(), mean, dmin, mmult, accuracy);
+}
 
-    return remappedData;
+void remap_avx2_xsimd_u8_with_mean_into(std::span<const float> in, std::span<uint8_t> out, double mean, int dmin,
+                                        int mmult, Log10Accuracy accuracy) {
+    assert(in.size() == out.size());
+    g_kernels->remap_with_mean_u8(in.data(), out.data(), in.size(), mean, dmin, mmult, accuracy);
 }
 
-namespace xs = xsimd;
+void remap_avx2_xsimd_into(std::span<const std::complex<float>> in, std::span<float> out, int dmin, int mmult,
+                           Log10Accuracy accuracy) {
+    assert(in.size() == out.size());
+    g_kernels->complex_samples.remap_xsimd(in.data(), out.data(), in.size(), dmin, mmult, accuracy);
+}
 
-float* remap_avx2_xsimd(const float* data, int dmin, int mmult, const int rows, const int cols) {
-    constexpr size_t simdWidth = xsimd::batch<float>::size; // AVX2 floats
-    const size_t size = rows * cols;
-    double total = 0.0;
+void remap_avx2_xsimd_into(std::span<const int16_t> in, std::span<float> out, int dmin, int mmult,
+                           Log10Accuracy accuracy) {
+    assert(in.size() == out.size());
+    g_kernels->int16_samples.remap_xsimd(in.data(), out.data(), in.size(), dmin, mmult, accuracy);
+}
 
-    #pragma omp parallel reduction(+:total)
-    {
-        xsimd::batch<float> localBatch(0.f);
+void remap_avx2_xsimd_u8_into(std::span<const std::complex<float>> in, std::span<uint8_t> out, int dmin,
+                              int mmult, Log10Accuracy accuracy) {
+    assert(in.size() == out.size());
+    g_kernels->complex_samples.remap_xsimd_u8(in.data(), out.data(), in.size(), dmin, mmult, accuracy);
+}
 
-        #pragma omp for nowait schedule(static)
-        for(size_t i = 0; i < size - size % simdWidth; i+= simdWidth) {
-            auto v = xs::load_aligned(&data[i]);
-            localBatch += xsimd::abs(v);
-        }
+void remap_avx2_xsimd_u8_into(std::span<const int16_t> in, std::span<uint8_t> out, int dmin, int mmult,
+                              Log10Accuracy accuracy) {
+    assert(in.size() == out.size());
+    g_kernels->int16_samples.remap_xsimd_u8(in.data(), out.data(), in.size(), dmin, mmult, accuracy);
+}
 
-        total += xsimd::reduce_add(localBatch);
+void remap_avx2_xsimd_into(std::span<const Float16> in, std::span<float> out, int dmin, int mmult,
+                           Log10Accuracy accuracy) {
+    assert(in.size() == out.size());
+    g_kernels->float16_samples.remap_xsimd(in.data(), out.data(), in.size(), dmin, mmult, accuracy);
+}
+
+void remap_avx2_xsimd_into(std::span<const BFloat16> in, std::span<float> out, int dmin, int mmult,
+                           Log10Accuracy accuracy) {
+    assert(in.size() == out.size());
+    g_kernels->bfloat16_samples.remap_xsimd(in.data(), out.data(), in.size(), dmin, mmult, accuracy);
+}
+
+void remap_avx2_xsimd_u8_into(std::span<const Float16> in, std::span<uint8_t> out, int dmin, int mmult,
+                              Log10Accuracy accuracy) {
+    assert(in.size() == out.size());
+    g_kernels->float16_samples.remap_xsimd_u8(in.data(), out.data(), in.size(), dmin, mmult, accuracy);
+}
+
+void remap_avx2_xsimd_u8_into(std::span<const BFloat16> in, std::span<uint8_t> out, int dmin, int mmult,
+                              Log10Accuracy accuracy) {
+    assert(in.size() == out.size());
+    g_kernels->bfloat16_samples.remap_xsimd_u8(in.data(), out.data(), in.size(), dmin, mmult, accuracy);
+}
+
+double _sum_avx2_xsimd_roi(const float* base, size_t pitch, Roi roi) {
+    assert(roi.x + roi.width <= pitch);
+    return g_kernels->roi_abs_sum(&base[roi.y * pitch + roi.x], pitch, roi.width, roi.height);
+}
+
+void remap_avx2_xsimd_roi_into(const float* base, size_t pitch, Roi roi, float* out, size_t outPitch, int dmin,
+                               int mmult, Log10Accuracy accuracy) {
+    assert(roi.x + roi.width <= pitch && roi.width <= outPitch);
+    g_kernels->remap_roi(&base[roi.y * pitch + roi.x], pitch, out, outPitch, roi.width, roi.height, dmin, mmult,
+                         accuracy);
+}
+
+void remap_avx2_xsimd_u8_roi_into(const float* base, size_t pitch, Roi roi, uint8_t* out, size_t outPitch,
+                                  int dmin, int mmult, Log10Accuracy accuracy) {
+    assert(roi.x + roi.width <= pitch && roi.width <= outPitch);
+    g_kernels->remap_roi_u8(&base[roi.y * pitch + roi.x], pitch, out, outPitch, roi.width, roi.height, dmin, mmult,
+                            accuracy);
+}
+
+void decimate_remap_into(std::span<const float> in, size_t rows, size_t cols, size_t factor, PoolMode mode,
+                         std::span<float> out, int dmin, int mmult, Log10Accuracy accuracy) {
+    // Not an assert: a bad factor would index levelOut out of bounds below
+    if(!std::has_single_bit(factor) || static_cast<size_t>(std::countr_zero(factor)) > sum_detail::kMaxPyramidLevels) {
+        throw std::invalid_argument("decimate_remap_into: factor must be a power of two from 1 to 2^16");
     }
+    assert(in.size() == rows * cols && out.size() == (rows / factor) * (cols / factor));
 
-    for(size_t i = size - size % simdWidth; i < size; i++) {
-        total += std::abs(data[i]);
+    // A 1x1 block pools to |x| itself, which is the plain remap
+    if(factor == 1) {
+        remap_avx2_xsimd_into(in, out, dmin, mmult, accuracy);
+        return;
     }
 
-    double mean = total / size;
+    const size_t levels = std::countr_zero(factor);
 
-    const float C_L = 0.8f * mean;
-    const float C_H = mmult * C_L;
-    (void)C_H;
-    const float slope = (255 - dmin) / std::log10(C_L);
-    const float constant = dmin - (slope * std::log10(C_L));
+    // Only the last level is kept, the ones below it stay in stripe scratch
+    float* levelOut[sum_detail::kMaxPyramidLevels] = {};
+    levelOut[levels - 1] = out.data();
+    g_kernels->pyramid_remap(in.data(), rows, cols, levels, mode, levelOut, dmin, mmult, accuracy);
+}
 
-    constexpr size_t alignment = 64;
-    float *remappedData = new (std::align_val_t{alignment}) float[size];
-    const float EPS = 1e-5f;
+std::vector<AlignedBuffer<float>> remap_pyramid(std::span<const float> in, size_t rows, size_t cols, size_t levels,
+                                                PoolMode mode, int dmin, int mmult, Log10Accuracy accuracy) {
+    assert(levels <= sum_detail::kMaxPyramidLevels);
+    assert(in.size() == rows * cols);
+
+    std::vector<AlignedBuffer<float>> pyramid;
+    pyramid.reserve(levels);
+    float* levelOut[sum_detail::kMaxPyramidLevels] = {};
+    for(size_t k = 0; k < levels; k++) {
+        pyramid.emplace_back((rows >> (k + 1)) * (cols >> (k + 1)));
+        levelOut[k] = pyramid[k].data();
+    }
+    if(levels > 0) {
+        g_kernels->pyramid_remap(in.data(), rows, cols, levels, mode, levelOut, dmin, mmult, accuracy);
+    }
+    return pyramid;
+}
 
-    const size_t arrSize = rows * cols;
+void filter_remap_into(std::span<const float> in, size_t rows, size_t cols, size_t window, std::span<float> out,
+                       int dmin, int mmult, Log10Accuracy accuracy) {
+    assert(window % 2 == 1);
+    assert(in.size() == rows * cols && out.size() == in.size());
+    g_kernels->filter_remap(in.data(), rows, cols, window, out.data(), dmin, mmult, accuracy);
+}
 
-    #pragma omp parallel for
-    for(size_t i = 0; i < arrSize; i += simdWidth) {
-        auto v = xs::load_aligned(&data[i]);
-        v = (slope * xs::log10(xs::max(xs::abs(v), xs::batch(EPS))) + constant);
-        v = xs::min(xs::max(v, xs::batch(0.f)), xs::batch(255.f));
-        v.store_aligned(&remappedData[i]);
-    }
+void filter_remap_u8_into(std::span<const float> in, size_t rows, size_t cols, size_t window,
+                          std::span<uint8_t> out, int dmin, int mmult, Log10Accuracy accuracy) {
+    assert(window % 2 == 1);
+    assert(in.size() == rows * cols && out.size() == in.size());
+    g_kernels->filter_remap_u8(in.data(), rows, cols, window, out.data(), dmin, mmult, accuracy);
+}
 
-    return remappedData;
-}
\ No newline at end of file
+// The remaps only read an element before writing the same element, so the
+// in-place versions are the "into" versions with the output aliasing the input
+
+void _remap_inplace(std::span<float> data, int dmin, int mmult) {
+    g_kernels->remap(data.data(), data.data(), data.size(), dmin, mmult);
+}
+
+void remap_avx2_scalar_log10_inplace(std::span<float> data, int dmin, int mmult) {
+    g_kernels->remap_avx2_scalar_log10(data.data(), data.data(), data.size(), dmin, mmult);
+}
+
+void remap_avx2_xsimd_inplace(std::span<float> data, int dmin, int mmult, Log10Accuracy accuracy) {
+    g_kernels->remap_avx2_xsimd(data.data(), data.data(), data.size(), dmin, mmult, accuracy);
+}
@@ -1,11 +1,164 @@
 #pragma once
 
+#include <complex>
 #include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "SumTypes.hpp"
+#include "AlignedBuffer.hpp"
+
+// Every kernel below is built for SSE4.2, AVX2 and AVX-512; the best build
+// for the running CPU is chosen once when the library is loaded.
+const char* sum_active_isa();
+
+// NUMA-aware mode for multi-socket hosts, off by default. Pins the OpenMP
+// team per socket, the calling thread included, and has the allocating
+// remaps place their output with the same static partition the kernels use
+// (see Numa.hpp). Turning it off, from the same thread, gives every thread
+// its old affinity back. Inputs are the caller's, touch them with
+// numa_first_touch when allocating them
+void sum_set_numa_aware(bool enabled);
 
 double _sum_avx2(float* __restrict__ data, size_t dataSize);
 double _sum_avx2_omp(float* __restrict__ data, size_t dataSize);
 double _sum_avx2_xsimd_omp(float* __restrict__ data, size_t dataSize);
+// Sum of |z| of interleaved I/Q, and sum of |x| of int16 samples. The
+// magnitude and the widening happen inside the vector loop
+double _sum_avx2_xsimd_omp(const std::complex<float>* data, size_t dataSize);
+double _sum_avx2_xsimd_omp(const int16_t* data, size_t dataSize);
+// The same sums over archived 16-bit floats, loaded with F16C or by
+// shift-widening bf16 and accumulated in double. _sum_avx2_omp is the signed
+// sum, _sum_avx2_xsimd_omp the sum of |x|
+double _sum_avx2_omp(const Float16* data, size_t dataSize);
+double _sum_avx2_omp(const BFloat16* data, size_t dataSize);
+double _sum_avx2_xsimd_omp(const Float16* data, size_t dataSize);
+double _sum_avx2_xsimd_omp(const BFloat16* data, size_t dataSize);
+// Bit-identical for any thread count and on every ISA build, for
+// reproducibility checks. Close to the throughput of the sums above
+double _sum_deterministic(std::span<const float> data);
+
+// Sum of squares (the energy of a frame) and dot product, in double, with the
+// same parallel reduction as the sums above
+double _sum_squares(std::span<const float> data);
+double _dot(std::span<const float> a, std::span<const float> b);
+
+// Sum, abs-sum, min, max, mean and variance in one vectorized, parallel pass
+FrameStats reduce_stats(std::span<const float> data);
+
+// Per-row and per-column sums or means of a row-major rows x cols frame, in
+// double, for gain normalization. "out" holds one value per row or column
+void reduce_rows(std::span<const float> data, size_t rows, size_t cols, std::span<double> out,
+                 AxisStat stat = AxisStat::Sum);
+void reduce_cols(std::span<const float> data, size_t rows, size_t cols, std::span<double> out,
+                 AxisStat stat = AxisStat::Sum);
+
+// The allocating remaps return 64-byte aligned buffers from the buffer pool
+// (see AlignedBuffer.hpp), so a frame loop gets the last frame's warm pages
+// back instead of faulting in new ones every call
+AlignedBuffer<float> _remap(float *data, int dmin, int mmult, const int rows, const int cols);
+AlignedBuffer<float> remap_avx2_scalar_log10(const float* data, int dmin, int mmult, const int rows, const int cols);
+AlignedBuffer<float> remap_avx2_xsimd(const float* data, int dmin, int mmult, const int rows, const int cols,
+                                      Log10Accuracy accuracy = Log10Accuracy::Exact);
+// Same as remap_avx2_xsimd, rounded to nearest and packed to bytes
+AlignedBuffer<uint8_t> remap_avx2_xsimd_u8(const float* data, int dmin, int mmult, const int rows, const int cols,
+                                           Log10Accuracy accuracy = Log10Accuracy::Exact);
+// Same as remap_avx2_xsimd with log10 replaced by a table keyed on the float's
+// exponent and top mantissa bits, built per call. If info is not null it gets
+// the worst-case deviation from the exact remap
+AlignedBuffer<float> remap_avx2_xsimd_lut(const float* data, int dmin, int mmult, const int rows, const int cols,
+                                          LutRemapInfo* info = nullptr);
+
+// Clip levels from percentiles of |x| rather than the mean, so a few bright
+// scatterers cannot drag them around. lowPercentile picks C_L, which maps to
+// dmin. highPercentile picks C_H, capped at mmult * C_L, which maps to 255.
+// Percentiles are fractions in [0, 1]. An empty frame has no clip levels and
+// leaves *levels as it was
+AlignedBuffer<float> remap_percentile(const float* data, int dmin, int mmult, const int rows, const int cols,
+                                      float lowPercentile = 0.5f, float highPercentile = 0.999f,
+                                      ClipLevels* levels = nullptr, Log10Accuracy accuracy = Log10Accuracy::Exact);
+
+// Allocation-free versions of the remaps above. They write into "out", which
+// must be the same size as "in", so a frame loop can reuse one output buffer
+// instead of faulting in a fresh one every call.
+void _remap_into(std::span<const float> in, std::span<float> out, int dmin, int mmult);
+void remap_avx2_scalar_log10_into(std::span<const float> in, std::span<float> out, int dmin, int mmult);
+void remap_avx2_xsimd_into(std::span<const float> in, std::span<float> out, int dmin, int mmult,
+                           Log10Accuracy accuracy = Log10Accuracy::Exact);
+void remap_avx2_xsimd_u8_into(std::span<const float> in, std::span<uint8_t> out, int dmin, int mmult,
+                              Log10Accuracy accuracy = Log10Accuracy::Exact);
+void remap_avx2_xsimd_lut_into(std::span<const float> in, std::span<float> out, int dmin, int mmult,
+                               LutRemapInfo* info = nullptr);
+void remap_percentile_into(std::span<const float> in, std::span<float> out, int dmin, int mmult,
+                           float lowPercentile = 0.5f, float highPercentile = 0.999f,
+                           ClipLevels* levels = nullptr, Log10Accuracy accuracy = Log10Accuracy::Exact);
+
+// The xsimd remaps with the mean magnitude supplied by the caller instead of
+// computed from "in". For frames that are remapped a piece at a time, where
+// the mean has to come from the whole frame
+void remap_avx2_xsimd_with_mean_into(std::span<const float> in, std::span<float> out, double mean, int dmin,
+                                     int mmult, Log10Accuracy accuracy = Log10Accuracy::Exact);
+void remap_avx2_xsimd_u8_with_mean_into(std::span<const float> in, std::span<uint8_t> out, double mean, int dmin,
+                                        int mmult, Log10Accuracy accuracy = Log10Accuracy::Exact);
+
+// The xsimd remaps straight from the sensor and archive formats. The mean and
+// the remap both work on |z| of the I/Q pairs, or on the int16 or 16-bit float
+// samples widened to float, without a conversion pass into a temporary frame
+void remap_avx2_xsimd_into(std::span<const std::complex<float>> in, std::span<float> out, int dmin, int mmult,
+                           Log10Accuracy accuracy = Log10Accuracy::Exact);
+void remap_avx2_xsimd_into(std::span<const int16_t> in, std::span<float> out, int dmin, int mmult,
+                           Log10Accuracy accuracy = Log10Accuracy::Exact);
+void remap_avx2_xsimd_u8_into(std::span<const std::complex<float>> in, std::span<uint8_t> out, int dmin,
+                              int mmult, Log10Accuracy accuracy = Log10Accuracy::Exact);
+void remap_avx2_xsimd_u8_into(std::span<const int16_t> in, std::span<uint8_t> out, int dmin, int mmult,
+                              Log10Accuracy accuracy = Log10Accuracy::Exact);
+void remap_avx2_xsimd_into(std::span<const Float16> in, std::span<float> out, int dmin, int mmult,
+                           Log10Accuracy accuracy = Log10Accuracy::Exact);
+void remap_avx2_xsimd_into(std::span<const BFloat16> in, std::span<float> out, int dmin, int mmult,
+                           Log10Accuracy accuracy = Log10Accuracy::Exact);
+void remap_avx2_xsimd_u8_into(std::span<const Float16> in, std::span<uint8_t> out, int dmin, int mmult,
+                              Log10Accuracy accuracy = Log10Accuracy::Exact);
+void remap_avx2_xsimd_u8_into(std::span<const BFloat16> in, std::span<uint8_t> out, int dmin, int mmult,
+                              Log10Accuracy accuracy = Log10Accuracy::Exact);
+
+// Region-of-interest versions for pitched images, e.g. a viewer's pan/zoom
+// window into a padded frame, read in place with no copy. "pitch" is the
+// distance between rows of "base" in elements. The remaps write roi.height
+// rows of roi.width to "out", outPitch elements apart, and take the clip
+// level from the ROI alone, as if it had been copied out first
+double _sum_avx2_xsimd_roi(const float* base, size_t pitch, Roi roi);
+void remap_avx2_xsimd_roi_into(const float* base, size_t pitch, Roi roi, float* out, size_t outPitch, int dmin,
+                               int mmult, Log10Accuracy accuracy = Log10Accuracy::Exact);
+void remap_avx2_xsimd_u8_roi_into(const float* base, size_t pitch, Roi roi, uint8_t* out, size_t outPitch,
+                                  int dmin, int mmult, Log10Accuracy accuracy = Log10Accuracy::Exact);
+
+// Display previews: |x| pooled over factor x factor blocks by mean or max,
+// then remapped, so the log10 only runs on the pooled values. factor is a
+// power of two from 1 to 2^16 (1 is the plain remap, anything else throws
+// std::invalid_argument), partial blocks at the right and bottom edges are
+// dropped, and "out" holds (rows / factor) * (cols / factor) elements.
+// The clip level comes from the full-resolution |x|, so a preview is as
+// bright as the full remap
+void decimate_remap_into(std::span<const float> in, size_t rows, size_t cols, size_t factor, PoolMode mode,
+                         std::span<float> out, int dmin, int mmult, Log10Accuracy accuracy = Log10Accuracy::Exact);
+// Every level of the mip pyramid from one pass over the frame. Level k is
+// decimated by 2^(k + 1) and is (rows >> (k + 1)) x (cols >> (k + 1))
+std::vector<AlignedBuffer<float>> remap_pyramid(std::span<const float> in, size_t rows, size_t cols, size_t levels,
+                                                PoolMode mode, int dmin, int mmult,
+                                                Log10Accuracy accuracy = Log10Accuracy::Exact);
+
+// Speckle smoothing for display: the mean of |x| over a window x window
+// neighbourhood, then the xsimd remap, in one tiled pass with no temporary
+// frame. window is odd. Near the edges the mean is over the part of the
+// window inside the frame. "out" must not alias "in"
+void filter_remap_into(std::span<const float> in, size_t rows, size_t cols, size_t window, std::span<float> out,
+                       int dmin, int mmult, Log10Accuracy accuracy = Log10Accuracy::Exact);
+void filter_remap_u8_into(std::span<const float> in, size_t rows, size_t cols, size_t window,
+                          std::span<uint8_t> out, int dmin, int mmult, Log10Accuracy accuracy = Log10Accuracy::Exact);
 
-float* _remap(float *data, int dmin, int mmult, const int rows, const int cols);
-float* remap_avx2_scalar_log10(const float* data, int dmin, int mmult, const int rows, const int cols);
-float* remap_avx2_xsimd(const float* data, int dmin, int mmult, const int rows, const int cols);
\ No newline at end of file
+// In-place versions, "data" is overwritten with its remap
+void _remap_inplace(std::span<float> data, int dmin, int mmult);
+void remap_avx2_scalar_log10_inplace(std::span<float> data, int dmin, int mmult);
+void remap_avx2_xsimd_inplace(std::span<float> data, int dmin, int mmult,
+                              Log10Accuracy accuracy = Log10Accuracy::Exact);
\ No newline at end of file
@@ -0,0 +1,1899 @@
+#include "SumKernels.hpp"
+#include <immintrin.h>
+#include <algorithm> // std::clamp
+#include <array>
+#include <bit> // std::bit_cast
+#include <cmath> // std::log10
+#include <complex>
+#include <cstddef> // std::size_t
+#include <cstdint> // uint8_t
+#include <limits>
+#include <vector>
+
+#include <omp.h>
+
+#include <xsimd/xsimd.hpp>
+
+// This file is built once per ISA (see CMakeLists.txt). Everything in here
+// lives in an anonymous namespace inside a namespace named after the ISA, and
+// only the KernelTable at the bottom is exported (see SumKernels.map).
+#if defined(__AVX512F__)
+#define SUM_KERNEL_NAMESPACE sum_kernels_avx512
+#define SUM_KERNEL_TABLE avx512_kernels
+#define SUM_KERNEL_NAME "avx512"
+#elif defined(__AVX2__)
+#define SUM_KERNEL_NAMESPACE sum_kernels_avx2
+#define SUM_KERNEL_TABLE avx2_kernels
+#define SUM_KERNEL_NAME "avx2"
+#else
+#define SUM_KERNEL_NAMESPACE sum_kernels_sse42
+#define SUM_KERNEL_TABLE sse42_kernels
+#define SUM_KERNEL_NAME "sse4.2"
+#endif
+
+namespace SUM_KERNEL_NAMESPACE {
+namespace {
+
+namespace xs = xsimd;
+
+/**
+ * The small set of raw intrinsics the hand-written kernels need, picked by the
+ * flags this translation unit is compiled with. kFloatLanes is the number of
+ * floats in one register.
+ */
+#if defined(__AVX512F__)
+
+constexpr size_t kFloatLanes = 16;
+using vec_ps = __m512;
+using vec_pd = __m512d;
+
+inline vec_ps loadu_ps(const float* p) { return _mm512_loadu_ps(p); }
+inline void storeu_ps(float* p, vec_ps v) { _mm512_storeu_ps(p, v); }
+inline vec_ps set1_ps(float x) { return _mm512_set1_ps(x); }
+inline vec_ps abs_ps(vec_ps v) { return _mm512_abs_ps(v); }
+inline vec_ps max_ps(vec_ps a, vec_ps b) { return _mm512_max_ps(a, b); }
+inline vec_ps min_ps(vec_ps a, vec_ps b) { return _mm512_min_ps(a, b); }
+inline vec_pd setzero_pd() { return _mm512_setzero_pd(); }
+inline vec_ps load_i16_ps(const int16_t* p) {
+    return _mm512_cvtepi32_ps(_mm512_cvtepi16_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p))));
+}
+
+// Converts both halves of v to double and adds them into acc
+inline vec_pd add_widened(vec_pd acc, vec_ps v) {
+    acc = _mm512_add_pd(acc, _mm512_cvtps_pd(_mm512_castps512_ps256(v)));
+    return _mm512_add_pd(acc, _mm512_cvtps_pd(_mm512_extractf32x8_ps(v, 1)));
+}
+
+inline double hsum_pd(vec_pd v) { return _mm512_reduce_add_pd(v); }
+
+inline vec_pd loadu_pd(const double* p) { return _mm512_loadu_pd(p); }
+inline void storeu_pd(double* p, vec_pd v) { _mm512_storeu_pd(p, v); }
+
+// The low and high halves of v as double, and back
+inline void widen_ps(vec_ps v, vec_pd& lo, vec_pd& hi) {
+    lo = _mm512_cvtps_pd(_mm512_castps512_ps256(v));
+    hi = _mm512_cvtps_pd(_mm512_extractf32x8_ps(v, 1));
+}
+inline vec_ps narrow_pd(vec_pd lo, vec_pd hi) {
+    return _mm512_insertf32x8(_mm512_castps256_ps512(_mm512_cvtpd_ps(lo)), _mm512_cvtpd_ps(hi), 1);
+}
+
+// Inclusive prefix sum of the lanes of v plus carry, and carry set to its
+// last lane. valignq against zero shifts the lanes up
+inline vec_pd scan_pd(vec_pd v, vec_pd& carry) {
+    const __m512i zero = _mm512_setzero_si512();
+    v = _mm512_add_pd(v, _mm512_castsi512_pd(_mm512_alignr_epi64(_mm512_castpd_si512(v), zero, 7)));
+    v = _mm512_add_pd(v, _mm512_castsi512_pd(_mm512_alignr_epi64(_mm512_castpd_si512(v), zero, 6)));
+    v = _mm512_add_pd(v, _mm512_castsi512_pd(_mm512_alignr_epi64(_mm512_castpd_si512(v), zero, 4)));
+    v = _mm512_add_pd(v, carry);
+    carry = _mm512_permutexvar_pd(_mm512_set1_epi64(7), v);
+    return v;
+}
+
+// Splits the 2 * kFloatLanes elements of a then b into even and odd elements
+inline void deinterleave_ps(vec_ps a, vec_ps b, vec_ps& even, vec_ps& odd) {
+    const __m512i evenIdx = _mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30);
+    even = _mm512_permutex2var_ps(a, evenIdx, b);
+    odd = _mm512_permutex2var_ps(a, _mm512_add_epi32(evenIdx, _mm512_set1_epi32(1)), b);
+}
+
+// The first n < kFloatLanes elements at p, the other lanes zero and never touched
+inline vec_ps loadu_partial_ps(const float* p, size_t n) {
+    return _mm512_maskz_loadu_ps(static_cast<__mmask16>((1u << n) - 1), p);
+}
+inline void storeu_partial_ps(float* p, vec_ps v, size_t n) {
+    _mm512_mask_storeu_ps(p, static_cast<__mmask16>((1u << n) - 1), v);
+}
+inline void store_u8_partial(uint8_t* out, vec_ps v, size_t n) {
+    _mm_mask_storeu_epi8(out, static_cast<__mmask16>((1u << n) - 1), _mm512_cvtusepi32_epi8(_mm512_cvtps_epi32(v)));
+}
+
+// Rounds four registers of values already clamped to [0, 255] to the nearest
+// integer and stores them as 4 * kFloatLanes saturated bytes
+inline void store_u8x4(uint8_t* out, vec_ps a, vec_ps b, vec_ps c, vec_ps d) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out),      _mm512_cvtusepi32_epi8(_mm512_cvtps_epi32(a)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16), _mm512_cvtusepi32_epi8(_mm512_cvtps_epi32(b)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 32), _mm512_cvtusepi32_epi8(_mm512_cvtps_epi32(c)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 48), _mm512_cvtusepi32_epi8(_mm512_cvtps_epi32(d)));
+}
+
+#elif defined(__AVX2__)
+
+constexpr size_t kFloatLanes = 8;
+using vec_ps = __m256;
+using vec_pd = __m256d;
+
+inline vec_ps loadu_ps(const float* p) { return _mm256_loadu_ps(p); }
+inline void storeu_ps(float* p, vec_ps v) { _mm256_storeu_ps(p, v); }
+inline vec_ps set1_ps(float x) { return _mm256_set1_ps(x); }
+inline vec_ps abs_ps(vec_ps v) { return _mm256_andnot_ps(_mm256_set1_ps(-0.f), v); }
+inline vec_ps max_ps(vec_ps a, vec_ps b) { return _mm256_max_ps(a, b); }
+inline vec_ps min_ps(vec_ps a, vec_ps b) { return _mm256_min_ps(a, b); }
+inline vec_pd setzero_pd() { return _mm256_setzero_pd(); }
+inline vec_ps load_i16_ps(const int16_t* p) {
+    return _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))));
+}
+
+inline vec_pd add_widened(vec_pd acc, vec_ps v) {
+    __m128 vlow  = _mm256_castps256_ps128(v);
+    __m128 vhigh = _mm256_extractf128_ps(v, 1);
+    acc = _mm256_add_pd(acc, _mm256_cvtps_pd(vlow));   // convert first 4 to double
+    return _mm256_add_pd(acc, _mm256_cvtps_pd(vhigh)); // convert next 4 to double
+}
+
+double hsum256_pd(__m256d v) {
+    // Extract the high 128-bit lane
+    __m128d vhigh = _mm256_extractf128_pd(v, 1); // upper 2 doubles
+    // Extract the low 128-bit lane
+    __m128d vlow  = _mm256_castpd256_pd128(v);   // lower 2 doubles
+    // Add the two 128-bit halves
+    __m128d sum128 = _mm_add_pd(vlow, vhigh);
+    // Horizontal add the two doubles in sum128
+    sum128 = _mm_hadd_pd(sum128, sum128);
+    // Extract final scalar
+    return _mm_cvtsd_f64(sum128);
+}
+
+inline double hsum_pd(vec_pd v) { return hsum256_pd(v); }
+
+inline vec_pd loadu_pd(const double* p) { return _mm256_loadu_pd(p); }
+inline void storeu_pd(double* p, vec_pd v) { _mm256_storeu_pd(p, v); }
+
+inline void widen_ps(vec_ps v, vec_pd& lo, vec_pd& hi) {
+    lo = _mm256_cvtps_pd(_mm256_castps256_ps128(v));
+    hi = _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1));
+}
+inline vec_ps narrow_pd(vec_pd lo, vec_pd hi) {
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(lo)), _mm256_cvtpd_ps(hi), 1);
+}
+
+inline vec_pd scan_pd(vec_pd v, vec_pd& carry) {
+    // Up one lane (lane 0 zeroed by the blend), then up two (the low half zeroed)
+    v = _mm256_add_pd(v, _mm256_blend_pd(_mm256_permute4x64_pd(v, _MM_SHUFFLE(2, 1, 0, 0)), _mm256_setzero_pd(), 0b0001));
+    v = _mm256_add_pd(v, _mm256_permute2f128_pd(v, v, 0x08));
+    v = _mm256_add_pd(v, carry);
+    carry = _mm256_permute4x64_pd(v, _MM_SHUFFLE(3, 3, 3, 3));
+    return v;
+}
+
+inline void deinterleave_ps(vec_ps a, vec_ps b, vec_ps& even, vec_ps& odd) {
+    // The shuffles work within 128-bit lanes, the permute puts the halves back in order
+    even = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))),
+                                                   _MM_SHUFFLE(3, 1, 2, 0)));
+    odd = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))),
+                                                  _MM_SHUFFLE(3, 1, 2, 0)));
+}
+
+inline __m256i partial_mask(size_t n) {
+    return _mm256_cmpgt_epi32(_mm256_set1_epi32(static_cast<int>(n)), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+}
+inline vec_ps loadu_partial_ps(const float* p, size_t n) { return _mm256_maskload_ps(p, partial_mask(n)); }
+inline void storeu_partial_ps(float* p, vec_ps v, size_t n) { _mm256_maskstore_ps(p, partial_mask(n), v); }
+// No byte-masked store before AVX-512, pack to a register and copy the bytes
+inline void store_u8_partial(uint8_t* out, vec_ps v, size_t n) {
+    __m128i words = _mm_packs_epi32(_mm256_castsi256_si128(_mm256_cvtps_epi32(v)),
+                                    _mm256_extracti128_si256(_mm256_cvtps_epi32(v), 1));
+    alignas(16) uint8_t bytes[16];
+    _mm_store_si128(reinterpret_cast<__m128i*>(bytes), _mm_packus_epi16(words, words));
+    std::copy_n(bytes, n, out);
+}
+
+inline void store_u8x4(uint8_t* out, vec_ps a, vec_ps b, vec_ps c, vec_ps d) {
+    __m256i ab = _mm256_packs_epi32(_mm256_cvtps_epi32(a), _mm256_cvtps_epi32(b));
+    __m256i cd = _mm256_packs_epi32(_mm256_cvtps_epi32(c), _mm256_cvtps_epi32(d));
+    __m256i bytes = _mm256_packus_epi16(ab, cd);
+    // The packs work within 128-bit lanes, put the 4-byte groups back in order
+    bytes = _mm256_permutevar8x32_epi32(bytes, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), bytes);
+}
+
+#else // SSE4.2
+
+constexpr size_t kFloatLanes = 4;
+using vec_ps = __m128;
+using vec_pd = __m128d;
+
+inline vec_ps loadu_ps(const float* p) { return _mm_loadu_ps(p); }
+inline void storeu_ps(float* p, vec_ps v) { _mm_storeu_ps(p, v); }
+inline vec_ps set1_ps(float x) { return _mm_set1_ps(x); }
+inline vec_ps abs_ps(vec_ps v) { return _mm_andnot_ps(_mm_set1_ps(-0.f), v); }
+inline vec_ps max_ps(vec_ps a, vec_ps b) { return _mm_max_ps(a, b); }
+inline vec_ps min_ps(vec_ps a, vec_ps b) { return _mm_min_ps(a, b); }
+inline vec_pd setzero_pd() { return _mm_setzero_pd(); }
+inline vec_ps load_i16_ps(const int16_t* p) {
+    return _mm_cvtepi32_ps(_mm_cvtepi16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p))));
+}
+
+inline vec_pd add_widened(vec_pd acc, vec_ps v) {
+    acc = _mm_add_pd(acc, _mm_cvtps_pd(v));
+    return _mm_add_pd(acc, _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+}
+
+inline double hsum_pd(vec_pd v) {
+    return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v)));
+}
+
+inline vec_pd loadu_pd(const double* p) { return _mm_loadu_pd(p); }
+inline void storeu_pd(double* p, vec_pd v) { _mm_storeu_pd(p, v); }
+
+inline void widen_ps(vec_ps v, vec_pd& lo, vec_pd& hi) {
+    lo = _mm_cvtps_pd(v);
+    hi = _mm_cvtps_pd(_mm_movehl_ps(v, v));
+}
+inline vec_ps narrow_pd(vec_pd lo, vec_pd hi) {
+    return _mm_movelh_ps(_mm_cvtpd_ps(lo), _mm_cvtpd_ps(hi));
+}
+
+inline vec_pd scan_pd(vec_pd v, vec_pd& carry) {
+    v = _mm_add_pd(v, _mm_castsi128_pd(_mm_slli_si128(_mm_castpd_si128(v), 8)));
+    v = _mm_add_pd(v, carry);
+    carry = _mm_unpackhi_pd(v, v);
+    return v;
+}
+
+inline void deinterleave_ps(vec_ps a, vec_ps b, vec_ps& even, vec_ps& odd) {
+    even = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+    odd = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+}
+
+// SSE has no masked loads, go through a register-sized buffer
+inline vec_ps loadu_partial_ps(const float* p, size_t n) {
+    alignas(16) float lanes[kFloatLanes] = {};
+    std::copy_n(p, n, lanes);
+    return _mm_load_ps(lanes);
+}
+inline void storeu_partial_ps(float* p, vec_ps v, size_t n) {
+    alignas(16) float lanes[kFloatLanes];
+    _mm_store_ps(lanes, v);
+    std::copy_n(lanes, n, p);
+}
+inline void store_u8_partial(uint8_t* out, vec_ps v, size_t n) {
+    __m128i words = _mm_packs_epi32(_mm_cvtps_epi32(v), _mm_cvtps_epi32(v));
+    alignas(16) uint8_t bytes[16];
+    _mm_store_si128(reinterpret_cast<__m128i*>(bytes), _mm_packus_epi16(words, words));
+    std::copy_n(bytes, n, out);
+}
+
+inline void store_u8x4(uint8_t* out, vec_ps a, vec_ps b, vec_ps c, vec_ps d) {
+    __m128i ab = _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b));
+    __m128i cd = _mm_packs_epi32(_mm_cvtps_epi32(c), _mm_cvtps_epi32(d));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_packus_epi16(ab, cd));
+}
+
+#endif
+
+// IEEE half to float with integer ops, for builds without F16C and for tails.
+// Shifting the exponent and mantissa into place and scaling by 2^112 rebases
+// the exponent and handles subnormals; infinities and NaNs get their
+// exponent forced to all ones.
+inline float float16_to_float(uint16_t h) {
+    const uint32_t magnitude = static_cast<uint32_t>(h & 0x7fff) << 13;
+    uint32_t bits = std::bit_cast<uint32_t>(std::bit_cast<float>(magnitude) * std::bit_cast<float>(0x77800000u));
+    if((h & 0x7fff) >= 0x7c00) {
+        bits |= 0x7f800000u;
+    }
+    return std::bit_cast<float>(bits | (static_cast<uint32_t>(h & 0x8000) << 16));
+}
+
+#if !defined(__F16C__)
+inline vec_ps load_f16_ps(const uint16_t* p) {
+    __m128i h = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)));
+    __m128i magnitude = _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x7fff)), 13);
+    __m128 f = _mm_mul_ps(_mm_castsi128_ps(magnitude), _mm_castsi128_ps(_mm_set1_epi32(0x77800000)));
+    __m128i special = _mm_cmpgt_epi32(_mm_and_si128(h, _mm_set1_epi32(0x7fff)), _mm_set1_epi32(0x7bff));
+    __m128i bits = _mm_or_si128(_mm_castps_si128(f), _mm_and_si128(special, _mm_set1_epi32(0x7f800000)));
+    bits = _mm_or_si128(bits, _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x8000)), 16));
+    return _mm_castsi128_ps(bits);
+}
+#endif
+
+inline float bfloat16_to_float(uint16_t h) {
+    return std::bit_cast<float>(static_cast<uint32_t>(h) << 16);
+}
+
+/**
+ * How one real input sample type turns into floats, a register at a time
+ * and one at a time for the tails. The xsimd kernels below are templated on
+ * the sample type, so widening int16 or 16-bit floats happens inside the
+ * same vector loop as the mean and the remap rather than in a separate pass.
+ */
+template <class T>
+struct Sample;
+
+template <>
+struct Sample<float> {
+    static xs::batch<float> load(const float* p) { return xs::load_unaligned(p); }
+    static float scalar(float x) { return x; }
+};
+
+template <>
+struct Sample<int16_t> {
+    static xs::batch<float> load(const int16_t* p) { return load_i16_ps(p); }
+    static float scalar(int16_t x) { return static_cast<float>(x); }
+};
+
+// F16C where the build has it (vcvtph2ps), the integer-op conversion otherwise
+template <>
+struct Sample<Float16> {
+    static xs::batch<float> load(const Float16* p) {
+        const auto* bits = reinterpret_cast<const uint16_t*>(p);
+#if defined(__AVX512F__)
+        return _mm512_cvtph_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(bits)));
+#elif defined(__F16C__)
+        return _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(bits)));
+#else
+        return load_f16_ps(bits);
+#endif
+    }
+    static float scalar(Float16 x) { return float16_to_float(x.bits); }
+};
+
+// bfloat16 is the top half of a float, so widening is a zero-extend and a shift
+template <>
+struct Sample<BFloat16> {
+    static xs::batch<float> load(const BFloat16* p) {
+        const auto* bits = reinterpret_cast<const uint16_t*>(p);
+#if defined(__AVX512F__)
+        __m512i wide = _mm512_cvtepu16_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(bits)));
+        return _mm512_castsi512_ps(_mm512_slli_epi32(wide, 16));
+#elif defined(__AVX2__)
+        __m256i wide = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(bits)));
+        return _mm256_castsi256_ps(_mm256_slli_epi32(wide, 16));
+#else
+        __m128i wide = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(bits)));
+        return _mm_castsi128_ps(_mm_slli_epi32(wide, 16));
+#endif
+    }
+    static float scalar(BFloat16 x) { return bfloat16_to_float(x.bits); }
+};
+
+// The float magnitudes of a sample type, |x| for the real ones
+template <class T>
+struct Magnitude {
+    static xs::batch<float> load(const T* p) { return xs::abs(Sample<T>::load(p)); }
+    static float scalar(T x) { return std::abs(Sample<T>::scalar(x)); }
+};
+
+// Interleaved I/Q, the complex batch load does the deinterleave
+template <>
+struct Magnitude<std::complex<float>> {
+    static xs::batch<float> load(const std::complex<float>* p) {
+        auto z = xs::batch<std::complex<float>>::load_unaligned(p);
+        return xs::sqrt(z.real() * z.real() + z.imag() * z.imag());
+    }
+    static float scalar(std::complex<float> z) { return std::sqrt(z.real() * z.real() + z.imag() * z.imag()); }
+};
+
+/**
+ * @brief The one reduction loop the sums are built on. "op" says what one
+ * register of elements starting at i contributes, op.load(i), and what one
+ * element does, op.scalar(i), for the tail; parallel_reduce does the rest.
+ *
+ * Each thread takes a static slice of kReduceUnroll-register blocks and
+ * keeps kReduceUnroll independent accumulators, so the adds of consecutive
+ * registers do not wait on each other's latency. Acc is what they add in:
+ * double, widening every register as the sums always have, or float, for
+ * when half the adds are worth the precision. The threads' totals and the
+ * tail are combined once at the end. With parallel false it runs on the
+ * calling thread alone, for chunks handed out by WorkPool.
+ */
+constexpr size_t kReduceUnroll = 4;
+
+template <class Acc>
+struct ReduceLanes;
+
+template <>
+struct ReduceLanes<double> {
+    xs::batch<double> lo{0.0};
+    xs::batch<double> hi{0.0};
+
+    void add(xs::batch<float> v) {
+        auto wide = xs::widen(v);
+        lo += wide[0];
+        hi += wide[1];
+    }
+    double total() const { return xs::reduce_add(lo + hi); }
+};
+
+template <>
+struct ReduceLanes<float> {
+    xs::batch<float> sum{0.f};
+
+    void add(xs::batch<float> v) { sum += v; }
+    double total() const { return xs::reduce_add(sum); }
+};
+
+template <class Op, class Acc = double>
+double parallel_reduce(size_t size, const Op& op, bool parallel = true) {
+    constexpr size_t lanes = xs::batch<float>::size;
+    constexpr size_t block = kReduceUnroll * lanes;
+    const size_t blocked = size - size % block;
+
+    double total = 0.0;
+
+    #pragma omp parallel reduction(+:total) if(parallel)
+    {
+        ReduceLanes<Acc> acc[kReduceUnroll];
+
+        #pragma omp for nowait schedule(static)
+        for(size_t i = 0; i < blocked; i += block) {
+            for(size_t u = 0; u < kReduceUnroll; u++) {
+                acc[u].add(op.load(i + u * lanes));
+            }
+        }
+
+        for(size_t u = 0; u < kReduceUnroll; u++) {
+            total += acc[u].total();
+        }
+    }
+
+    // Fewer than a block left: whole registers, then single elements
+    ReduceLanes<Acc> tail;
+    size_t i = blocked;
+    for(; i + lanes <= size; i += lanes) {
+        tail.add(op.load(i));
+    }
+    total += tail.total();
+    for(; i < size; i++) {
+        total += op.scalar(i);
+    }
+
+    return total;
+}
+
+// What Loader makes of each element of data
+template <class Loader, class T>
+struct LoadOp {
+    const T* data;
+
+    xs::batch<float> load(size_t i) const { return Loader::load(&data[i]); }
+    float scalar(size_t i) const { return Loader::scalar(data[i]); }
+};
+
+template <class T>
+struct SquareOp {
+    const T* data;
+
+    xs::batch<float> load(size_t i) const {
+        auto x = Sample<T>::load(&data[i]);
+        return x * x;
+    }
+    float scalar(size_t i) const {
+        const float x = Sample<T>::scalar(data[i]);
+        return x * x;
+    }
+};
+
+struct DotOp {
+    const float* a;
+    const float* b;
+
+    xs::batch<float> load(size_t i) const { return xs::load_unaligned(&a[i]) * xs::load_unaligned(&b[i]); }
+    float scalar(size_t i) const { return a[i] * b[i]; }
+};
+
+// Sum of what Loader makes of data, accumulated in double
+template <class Loader, class T>
+double widened_sum(const T* __restrict__ data, size_t dataSize, bool parallel = true) {
+    return parallel_reduce(dataSize, LoadOp<Loader, T>{data}, parallel);
+}
+
+// Sum of the magnitudes of data
+template <class T>
+double magnitude_sum(const T* __restrict__ data, size_t dataSize) {
+    return widened_sum<Magnitude<T>>(data, dataSize);
+}
+
+// Signed sum of real samples
+template <class T>
+double value_sum(const T* __restrict__ data, size_t dataSize) {
+    return widened_sum<Sample<T>>(data, dataSize);
+}
+
+// The signed sum on the calling thread alone
+double _sum_avx2(const float* __restrict__ data, size_t dataSize) {
+    return widened_sum<Sample<float>>(data, dataSize, false);
+}
+
+/**
+ * @brief Computes the sum of "data" using OpenMP and
+ * AVX2 vector instructions
+ *
+ * @param data The buffer which we are summing over
+ * @param n The size of the buffer
+ * @return double
+ */
+double _sum_avx2_omp(const float* __restrict__ data, size_t n) {
+    return value_sum(data, n);
+}
+
+double sum_squares(const float* data, size_t size) {
+    return parallel_reduce(size, SquareOp<float>{data});
+}
+
+double dot(const float* a, const float* b, size_t size) {
+    return parallel_reduce(size, DotOp{a, b});
+}
+
+double _sum_avx2_xsimd_omp(const float* __restrict__ data, size_t dataSize) {
+    return magnitude_sum(data, dataSize);
+}
+
+void _remap_into(const float* data, float* remappedData, size_t size, int dmin, int mmult) {
+    double mean = 0.0;
+    #pragma omp parallel for reduction(+:mean)
+    for(size_t i = 0; i < size; i++) {
+        mean += std::abs(data[i]);
+    }
+    mean /= size;
+
+    const float C_L = 0.8f * mean;
+    const float C_H = mmult * C_L;
+    (void)C_H;
+    const float slope = (255 - dmin) / std::log10(C_L);
+    const float constant = dmin - (slope * std::log10(C_L));
+
+    const float EPS = 1e-5f;
+
+    #pragma omp parallel for
+    for(size_t i = 0; i < size; i++) {
+        const auto remappedVal = slope * std::log10(std::max(std::abs(data[i]), EPS)) + constant;
+        if(remappedVal > 255) {
+            remappedData[i] = 255;
+        } else if(remappedVal < 0) {
+            remappedData[i] = 0;
+        } else {
+            remappedData[i] = remappedVal;
+        }
+    }
+}
+
+void remap_avx2_scalar_log10_into(const float* data, float* remappedData, size_t size, int dmin, int mmult)
+{
+    double mean = 0.0;
+    #pragma omp parallel for reduction(+:mean)
+    for(size_t i = 0; i < size; i++) {
+        mean += std::abs(data[i]);
+    }
+    mean /= size;
+
+    const float C_L = 0.8f * mean;
+    const float C_H = mmult * C_L;
+    (void)C_H;
+    const float slope = (255 - dmin) / std::log10(C_L);
+    const float constant = dmin - (slope * std::log10(C_L));
+
+    const float EPS = 1e-5f;
+
+    constexpr size_t simdWidth = kFloatLanes;
+    const size_t vectorEnd = size - size % simdWidth;
+
+    #pragma omp parallel for
+    for (size_t i = 0; i < vectorEnd; i += simdWidth) {
+        vec_ps v = loadu_ps(data + i);
+
+        // vectorized abs and max(EPS)
+        vec_ps vabs = max_ps(abs_ps(v), set1_ps(EPS));
+
+        // extract elements to scalar for log10
+        alignas(64) float temp[simdWidth];
+        storeu_ps(temp, vabs);  // store the processed values to temp array
+
+        for (size_t j = 0; j < simdWidth; j++) {
+            temp[j] = slope * std::log10(temp[j]) + constant;
+        }
+
+        // vectorize clamp
+        vec_ps vremap = loadu_ps(temp);
+        vec_ps vclamp = min_ps(max_ps(vremap, set1_ps(0.f)), set1_ps(255.f));
+
+        storeu_ps(remappedData + i, vclamp);
+    }
+
+    // tail loop for remaining elements
+    for (size_t i = vectorEnd; i < size; i++) {
+        float val = slope * std::log10(std::max(std::abs(data[i]), EPS)) + constant;
+        remappedData[i] = std::clamp(val, 0.f, 255.f);
+    }
+}
+
+/**
+ * In-house vector log10 for the cheaper Log10Accuracy tiers. x is split into
+ * 2^e * m with m in [sqrt(0.5), sqrt(2)), log2(m) comes from a minimax
+ * polynomial in t = m - 1 (no constant term, so it stays accurate near 1) and
+ * log10(x) = (e + log2(m)) * log10(2). x has to be a positive normal float,
+ * which the remaps guarantee with max(|x|, EPS).
+ */
+template <size_t N>
+xs::batch<float> log10_poly(xs::batch<float> x, const std::array<float, N>& coeffs) {
+    using batch = xs::batch<float>;
+    using ibatch = xs::batch<int32_t>;
+
+    const ibatch bits = xs::bitwise_cast<int32_t>(x);
+    // Exponent relative to sqrt(0.5), so m lands in [sqrt(0.5), sqrt(2))
+    const ibatch e = (bits - ibatch(0x3f3504f3)) >> 23;
+    const batch t = xs::bitwise_cast<float>(bits - (e << 23)) - batch(1.f);
+
+    batch poly(coeffs[N - 1]);
+    for(size_t k = N - 1; k-- > 0;) {
+        poly = xs::fma(poly, t, batch(coeffs[k]));
+    }
+
+    const batch log2x = xs::fma(poly, t, xs::batch_cast<float>(e));
+    return log2x * batch(0.30102999566f);
+}
+
+// log2(1 + t) ~= t * (c0 + c1 t + ...), Remez fits over [sqrt(0.5) - 1, sqrt(2) - 1]
+constexpr std::array<float, 5> kLog2Fast = {
+    1.442263640e+00f, -7.211594881e-01f, 4.966255758e-01f, -3.811537701e-01f, 1.823696030e-01f
+};
+constexpr std::array<float, 3> kLog2Display = {
+    1.464441288e+00f, -7.318103134e-01f, 2.322882031e-01f
+};
+
+/**
+ * @brief Calls f with the log10 for the requested tier. Each tier gets its
+ * own copy of the caller's loop instead of a branch per batch.
+ */
+template <class F>
+void with_log10(Log10Accuracy accuracy, F&& f) {
+    switch(accuracy) {
+    case Log10Accuracy::Fast:
+        f([](xs::batch<float> x) { return log10_poly(x, kLog2Fast); });
+        return;
+    case Log10Accuracy::Display8Bit:
+        f([](xs::batch<float> x) { return log10_poly(x, kLog2Display); });
+        return;
+    case Log10Accuracy::Exact:
+        break;
+    }
+
+    f([](xs::batch<float> x) { return xs::log10(x); });
+}
+
+struct RemapLevels {
+    float slope;
+    float constant;
+};
+
+// The log-remap line through (C_L, dmin), computed exactly as the float
+// remaps above do it
+RemapLevels remap_levels(double mean, int dmin, int mmult) {
+    const float C_L = 0.8f * mean;
+    const float C_H = mmult * C_L;
+    (void)C_H;
+    const float slope = (255 - dmin) / std::log10(C_L);
+    const float constant = dmin - (slope * std::log10(C_L));
+    return {slope, constant};
+}
+
+/**
+ * @brief The second pass of every xsimd float remap, once the clip levels
+ * are known: out = clamp(slope * log10(max(|x|, EPS)) + constant, 0, 255).
+ */
+template <class T>
+void apply_remap(const T* data, float* remappedData, size_t size, RemapLevels levels,
+                 Log10Accuracy accuracy, bool parallel = true) {
+    constexpr size_t simdWidth = xsimd::batch<float>::size;
+    const auto [slope, constant] = levels;
+    const float EPS = 1e-5f;
+    const size_t vectorEnd = size - size % simdWidth;
+
+    with_log10(accuracy, [&](auto log10) {
+        #pragma omp parallel for if(parallel)
+        for(size_t i = 0; i < vectorEnd; i += simdWidth) {
+            auto v = Magnitude<T>::load(&data[i]);
+            v = (slope * log10(xs::max(v, xs::batch(EPS))) + constant);
+            v = xs::min(xs::max(v, xs::batch(0.f)), xs::batch(255.f));
+            v.store_unaligned(&remappedData[i]);
+        }
+    });
+
+    for(size_t i = vectorEnd; i < size; i++) {
+        float val = slope * std::log10(std::max(Magnitude<T>::scalar(data[i]), EPS)) + constant;
+        remappedData[i] = std::clamp(val, 0.f, 255.f);
+    }
+}
+
+template <class T>
+void remap_avx2_xsimd_into(const T* data, float* remappedData, size_t size, int dmin, int mmult,
+                           Log10Accuracy accuracy) {
+    // The abs-sum accumulates in double, summing |x| in float lanes drifts
+    // far enough on large frames to move the clip level
+    double mean = magnitude_sum(data, size) / size;
+
+    apply_remap(data, remappedData, size, remap_levels(mean, dmin, mmult), accuracy);
+}
+
+// One element of the remap before the clamp, the expression _remap uses
+inline float remap_scalar(float magnitude, RemapLevels levels) {
+    const float EPS = 1e-5f;
+    return levels.slope * std::log10(std::max(magnitude, EPS)) + levels.constant;
+}
+
+/**
+ * @brief The u8 counterpart of apply_remap, rounded to nearest and packed
+ * to bytes. The Exact tier has to come out as _remap rounded, and xs::log10
+ * is not correctly rounded, so a value near .5 could round the other way.
+ * That tier takes the magnitudes a register at a time but the log10 with
+ * std::log10 per element, like remap_avx2_scalar_log10.
+ */
+template <class T>
+void apply_remap_u8(const T* data, uint8_t* remappedData, size_t size, RemapLevels levels,
+                    Log10Accuracy accuracy, bool parallel = true) {
+    using batch = xs::batch<float>;
+    static_assert(batch::size == kFloatLanes, "xsimd and the raw intrinsics must agree on the register width");
+
+    const auto [slope, constant] = levels;
+    const float EPS = 1e-5f;
+
+    // Four registers per step so the packs fill a whole register of bytes
+    constexpr size_t step = 4 * kFloatLanes;
+    const size_t vectorEnd = size - size % step;
+
+    const auto run = [&](auto remapBatch) {
+        #pragma omp parallel for if(parallel)
+        for(size_t i = 0; i < vectorEnd; i += step) {
+            store_u8x4(&remappedData[i],
+                       remapBatch(&data[i]),
+                       remapBatch(&data[i + kFloatLanes]),
+                       remapBatch(&data[i + 2 * kFloatLanes]),
+                       remapBatch(&data[i + 3 * kFloatLanes]));
+        }
+    };
+
+    if(accuracy == Log10Accuracy::Exact) {
+        run([=](const T* p) -> vec_ps {
+            alignas(64) float lanes[kFloatLanes];
+            Magnitude<T>::load(p).store_aligned(lanes);
+            for(float& x : lanes) {
+                x = std::clamp(remap_scalar(x, levels), 0.f, 255.f);
+            }
+            return loadu_ps(lanes);
+        });
+    } else {
+        with_log10(accuracy, [&](auto log10) {
+            run([=](const T* p) -> vec_ps {
+                auto v = Magnitude<T>::load(p);
+                v = (slope * log10(xs::max(v, batch(EPS))) + constant);
+                return xs::min(xs::max(v, batch(0.f)), batch(255.f));
+            });
+        });
+    }
+
+    for(size_t i = vectorEnd; i < size; i++) {
+        const float val = remap_scalar(Magnitude<T>::scalar(data[i]), levels);
+        remappedData[i] = static_cast<uint8_t>(std::nearbyint(std::clamp(val, 0.f, 255.f)));
+    }
+}
+
+/**
+ * @brief Same remap as remap_avx2_xsimd but the result is rounded to nearest
+ * and stored as bytes, so the output is a quarter of the size. The mean is
+ * accumulated in double like _remap so that the output matches _remap
+ * rounded to the nearest integer.
+ *
+ * @param data The magnitudes to remap
+ * @param remappedData Where the size bytes of output go
+ * @param size The number of elements in data
+ */
+template <class T>
+void remap_avx2_xsimd_u8_into(const T* data, uint8_t* remappedData, size_t size, int dmin, int mmult,
+                              Log10Accuracy accuracy) {
+    const double mean = magnitude_sum(data, size) / size;
+    apply_remap_u8(data, remappedData, size, remap_levels(mean, dmin, mmult), accuracy);
+}
+
+// The second pass alone, for callers that already know the frame's mean
+// magnitude, e.g. because they streamed the frame through the sum first
+void remap_with_mean_into(const float* data, float* remappedData, size_t size, double mean, int dmin, int mmult,
+                          Log10Accuracy accuracy) {
+    apply_remap(data, remappedData, size, remap_levels(mean, dmin, mmult), accuracy);
+}
+
+void remap_with_mean_u8_into(const float* data, uint8_t* remappedData, size_t size, double mean, int dmin,
+                             int mmult, Log10Accuracy accuracy) {
+    apply_remap_u8(data, remappedData, size, remap_levels(mean, dmin, mmult), accuracy);
+}
+
+/**
+ * @brief One pass that both remaps with an already known mean and sums |x|
+ * for the next frame's clip level, so a video-rate stream reads each frame
+ * once. Returns the sum of |x|, accumulated in double as magnitude_sum does.
+ */
+double remap_fused_into(const float* data, float* remappedData, size_t size, double mean, int dmin, int mmult,
+                        Log10Accuracy accuracy) {
+    constexpr size_t simdWidth = xsimd::batch<float>::size;
+    const auto [slope, constant] = remap_levels(mean, dmin, mmult);
+    const float EPS = 1e-5f;
+    const size_t vectorEnd = size - size % simdWidth;
+
+    double total = 0.0;
+
+    with_log10(accuracy, [&](auto log10) {
+        #pragma omp parallel reduction(+:total)
+        {
+            xsimd::batch<double> localBatch1(0.f);
+            xsimd::batch<double> localBatch2(0.f);
+
+            #pragma omp for nowait schedule(static)
+            for(size_t i = 0; i < vectorEnd; i += simdWidth) {
+                auto v = Magnitude<float>::load(&data[i]);
+                auto converted = xsimd::widen(v);
+                localBatch1 += converted[0];
+                localBatch2 += converted[1];
+
+                v = (slope * log10(xs::max(v, xs::batch(EPS))) + constant);
+                v = xs::min(xs::max(v, xs::batch(0.f)), xs::batch(255.f));
+                v.store_unaligned(&remappedData[i]);
+            }
+
+            total += (xsimd::reduce_add(localBatch1) + xsimd::reduce_add(localBatch2));
+        }
+    });
+
+    for(size_t i = vectorEnd; i < size; i++) {
+        const float magnitude = std::abs(data[i]);
+        total += magnitude;
+        float val = slope * std::log10(std::max(magnitude, EPS)) + constant;
+        remappedData[i] = std::clamp(val, 0.f, 255.f);
+    }
+
+    return total;
+}
+
+double remap_fused_u8_into(const float* data, uint8_t* remappedData, size_t size, double mean, int dmin, int mmult,
+                           Log10Accuracy accuracy) {
+    using batch = xs::batch<float>;
+    const auto [slope, constant] = remap_levels(mean, dmin, mmult);
+    const float EPS = 1e-5f;
+
+    constexpr size_t step = 4 * kFloatLanes;
+    const size_t vectorEnd = size - size % step;
+
+    double total = 0.0;
+
+    with_log10(accuracy, [&](auto log10) {
+        #pragma omp parallel reduction(+:total)
+        {
+            xsimd::batch<double> localBatch1(0.f);
+            xsimd::batch<double> localBatch2(0.f);
+
+            const auto remapBatch = [&](const float* p) -> vec_ps {
+                auto v = Magnitude<float>::load(p);
+                auto converted = xsimd::widen(v);
+                localBatch1 += converted[0];
+                localBatch2 += converted[1];
+
+                v = (slope * log10(xs::max(v, batch(EPS))) + constant);
+                return xs::min(xs::max(v, batch(0.f)), batch(255.f));
+            };
+
+            #pragma omp for nowait schedule(static)
+            for(size_t i = 0; i < vectorEnd; i += step) {
+                store_u8x4(&remappedData[i],
+                           remapBatch(&data[i]),
+                           remapBatch(&data[i + kFloatLanes]),
+                           remapBatch(&data[i + 2 * kFloatLanes]),
+                           remapBatch(&data[i + 3 * kFloatLanes]));
+            }
+
+            total += (xsimd::reduce_add(localBatch1) + xsimd::reduce_add(localBatch2));
+        }
+    });
+
+    for(size_t i = vectorEnd; i < size; i++) {
+        const float magnitude = std::abs(data[i]);
+        total += magnitude;
+        float val = slope * std::log10(std::max(magnitude, EPS)) + constant;
+        remappedData[i] = static_cast<uint8_t>(std::nearbyint(std::clamp(val, 0.f, 255.f)));
+    }
+
+    return total;
+}
+
+/**
+ * Region-of-interest kernels for pitched images. "in" and "out" point at the
+ * first element of the region, rows are inPitch and outPitch elements apart.
+ * Each row runs the same vector loop as the dense kernels from wherever it
+ * starts, unaligned loads cost nothing extra on anything we run on, and the
+ * last partial register is a masked load and store so nothing outside the
+ * region is read or written.
+ */
+double row_abs_sum(const float* row, size_t width) {
+    using batch = xs::batch<float>;
+    xs::batch<double> acc1(0.), acc2(0.);
+
+    size_t i = 0;
+    for(; i + kFloatLanes <= width; i += kFloatLanes) {
+        auto converted = xs::widen(xs::abs(batch::load_unaligned(&row[i])));
+        acc1 += converted[0];
+        acc2 += converted[1];
+    }
+    if(i < width) {
+        auto converted = xs::widen(xs::abs(batch(loadu_partial_ps(&row[i], width - i))));
+        acc1 += converted[0];
+        acc2 += converted[1];
+    }
+
+    return xs::reduce_add(acc1) + xs::reduce_add(acc2);
+}
+
+double roi_abs_sum(const float* in, size_t inPitch, size_t width, size_t height) {
+    double total = 0.0;
+
+    #pragma omp parallel for reduction(+:total) schedule(static)
+    for(size_t r = 0; r < height; r++) {
+        total += row_abs_sum(&in[r * inPitch], width);
+    }
+
+    return total;
+}
+
+// One row of the remap, remapBatch turning a register of inputs into
+// clamped output levels. The last partial register is masked
+template <class RemapBatch>
+void remap_row(const float* src, float* dst, size_t width, RemapBatch remapBatch) {
+    size_t i = 0;
+    for(; i + kFloatLanes <= width; i += kFloatLanes) {
+        storeu_ps(&dst[i], remapBatch(loadu_ps(&src[i])));
+    }
+    if(i < width) {
+        storeu_partial_ps(&dst[i], remapBatch(loadu_partial_ps(&src[i], width - i)), width - i);
+    }
+}
+
+template <class RemapBatch>
+void remap_row(const float* src, uint8_t* dst, size_t width, RemapBatch remapBatch) {
+    constexpr size_t step = 4 * kFloatLanes;
+
+    size_t i = 0;
+    for(; i + step <= width; i += step) {
+        store_u8x4(&dst[i],
+                   remapBatch(loadu_ps(&src[i])),
+                   remapBatch(loadu_ps(&src[i + kFloatLanes])),
+                   remapBatch(loadu_ps(&src[i + 2 * kFloatLanes])),
+                   remapBatch(loadu_ps(&src[i + 3 * kFloatLanes])));
+    }
+    for(; i < width; i += kFloatLanes) {
+        const size_t n = std::min(kFloatLanes, width - i);
+        store_u8_partial(&dst[i], remapBatch(loadu_partial_ps(&src[i], n)), n);
+    }
+}
+
+// Calls f with the register remap for the given clip levels and log10 tier
+template <class F>
+void with_remap_batch(RemapLevels levels, Log10Accuracy accuracy, F&& f) {
+    using batch = xs::batch<float>;
+    const auto [slope, constant] = levels;
+    const float EPS = 1e-5f;
+
+    with_log10(accuracy, [&](auto log10) {
+        f([=](vec_ps x) -> vec_ps {
+            batch v = (slope * log10(xs::max(xs::abs(batch(x)), batch(EPS))) + constant);
+            return xs::min(xs::max(v, batch(0.f)), batch(255.f));
+        });
+    });
+}
+
+template <class Out>
+void remap_roi_impl(const float* in, size_t inPitch, Out* out, size_t outPitch, size_t width, size_t height,
+                    int dmin, int mmult, Log10Accuracy accuracy) {
+    if(width == 0 || height == 0) {
+        return;
+    }
+
+    const double mean = roi_abs_sum(in, inPitch, width, height) / (width * height);
+
+    with_remap_batch(remap_levels(mean, dmin, mmult), accuracy, [&](auto remapBatch) {
+        #pragma omp parallel for schedule(static)
+        for(size_t r = 0; r < height; r++) {
+            remap_row(&in[r * inPitch], &out[r * outPitch], width, remapBatch);
+        }
+    });
+}
+
+void remap_roi_into(const float* in, size_t inPitch, float* out, size_t outPitch, size_t width, size_t height,
+                    int dmin, int mmult, Log10Accuracy accuracy) {
+    remap_roi_impl(in, inPitch, out, outPitch, width, height, dmin, mmult, accuracy);
+}
+
+void remap_roi_u8_into(const float* in, size_t inPitch, uint8_t* out, size_t outPitch, size_t width,
+                       size_t height, int dmin, int mmult, Log10Accuracy accuracy) {
+    remap_roi_impl(in, inPitch, out, outPitch, width, height, dmin, mmult, accuracy);
+}
+
+// Per-thread scratch for the tiled kernels below
+template <class T>
+struct ScratchBuffer {
+    explicit ScratchBuffer(size_t size) : data(new T[size]) {}
+    ~ScratchBuffer() { delete[] data; }
+    ScratchBuffer(const ScratchBuffer&) = delete;
+    ScratchBuffer& operator=(const ScratchBuffer&) = delete;
+
+    T* data;
+};
+
+/**
+ * Preview pyramids. Level k of a pyramid is the frame's |x| pooled over
+ * 2^(k+1) x 2^(k+1) blocks, by mean (box) or max, with odd rows and columns
+ * left over at the edges dropped. Each level is pooled 2x2 from the one
+ * below, and the log10 of the remap only ever runs on the pooled values.
+ */
+
+// Accumulates |x| of the input for the clip level, the vector part in two
+// double registers like magnitude_sum and the scalar tails in "tail"
+struct PoolSum {
+    xs::batch<double> lanes1{0.};
+    xs::batch<double> lanes2{0.};
+    double tail = 0.0;
+};
+
+/**
+ * @brief One row of the next level from two rows of the level below. From
+ * the input the samples go through |x| first and are added into "sum".
+ */
+template <bool Max, bool FromInput>
+void pool_row_pair(const float* a, const float* b, float* dst, size_t dstCols, PoolSum& sum) {
+    using batch = xs::batch<float>;
+
+    const auto load = [&](const float* p) {
+        batch v = batch::load_unaligned(p);
+        if constexpr(FromInput) {
+            v = xs::abs(v);
+            auto converted = xs::widen(v);
+            sum.lanes1 += converted[0];
+            sum.lanes2 += converted[1];
+        }
+        return v;
+    };
+    const auto combine = [](batch x, batch y) {
+        if constexpr(Max) {
+            return xs::max(x, y);
+        } else {
+            return x + y;
+        }
+    };
+
+    size_t c = 0;
+    for(; c + kFloatLanes <= dstCols; c += kFloatLanes) {
+        const float* pa = &a[2 * c];
+        const float* pb = &b[2 * c];
+        const batch lo = combine(load(pa), load(pb));
+        const batch hi = combine(load(pa + kFloatLanes), load(pb + kFloatLanes));
+
+        // Neighbouring columns into matching lanes of two registers
+        vec_ps even, odd;
+        deinterleave_ps(lo, hi, even, odd);
+        batch pooled = combine(batch(even), batch(odd));
+        if constexpr(!Max) {
+            pooled *= batch(0.25f);
+        }
+        pooled.store_unaligned(&dst[c]);
+    }
+
+    for(; c < dstCols; c++) {
+        float block[4] = {a[2 * c], a[2 * c + 1], b[2 * c], b[2 * c + 1]};
+        if constexpr(FromInput) {
+            for(float& x : block) {
+                x = std::abs(x);
+                sum.tail += x;
+            }
+        }
+        if constexpr(Max) {
+            dst[c] = std::max(std::max(block[0], block[1]), std::max(block[2], block[3]));
+        } else {
+            dst[c] = 0.25f * ((block[0] + block[1]) + (block[2] + block[3]));
+        }
+    }
+}
+
+/**
+ * @brief Pools levels 1..levels of the pyramid of "in" and remaps the ones
+ * with a non-null out[k] in place. The frame is read once, in stripes of
+ * 2^levels input rows: a stripe makes one row of the top level, and every
+ * level's rows for it are made while the rows below are still in cache.
+ * Levels with a null out[k] only ever live in a stripe's worth of scratch.
+ *
+ * The clip level is the mean |x| of the input the pyramid covers, so the
+ * previews match the full resolution remap's brightness.
+ */
+template <bool Max>
+void pyramid_remap_impl(const float* in, size_t rows, size_t cols, size_t levels, float* const* out, int dmin,
+                        int mmult, Log10Accuracy accuracy) {
+    using sum_detail::kMaxPyramidLevels;
+    size_t levelRows[kMaxPyramidLevels], levelCols[kMaxPyramidLevels];
+    size_t stripeRows[kMaxPyramidLevels], scratchOffset[kMaxPyramidLevels];
+    size_t scratchSize = 0;
+    for(size_t k = 0; k < levels; k++) {
+        levelRows[k] = rows >> (k + 1);
+        levelCols[k] = cols >> (k + 1);
+        stripeRows[k] = size_t{1} << (levels - 1 - k);
+        scratchOffset[k] = scratchSize;
+        if(out[k] == nullptr) {
+            scratchSize += stripeRows[k] * levelCols[k];
+        }
+    }
+    if(levelRows[0] == 0 || levelCols[0] == 0) {
+        return;
+    }
+
+    const size_t stripes = (levelRows[0] + stripeRows[0] - 1) / stripeRows[0];
+    double total = 0.0;
+
+    #pragma omp parallel reduction(+:total)
+    {
+        ScratchBuffer<float> scratch(scratchSize);
+        PoolSum sum;
+
+        #pragma omp for schedule(static)
+        for(size_t s = 0; s < stripes; s++) {
+            // Row j of level k, in the caller's buffer or this stripe's scratch
+            const auto row = [&](size_t k, size_t j) {
+                if(out[k] != nullptr) {
+                    return &out[k][j * levelCols[k]];
+                }
+                return &scratch.data[scratchOffset[k] + (j - s * stripeRows[k]) * levelCols[k]];
+            };
+
+            for(size_t k = 0; k < levels; k++) {
+                const size_t first = s * stripeRows[k];
+                const size_t last = std::min(first + stripeRows[k], levelRows[k]);
+                for(size_t j = first; j < last; j++) {
+                    if(k == 0) {
+                        pool_row_pair<Max, true>(&in[2 * j * cols], &in[(2 * j + 1) * cols], row(0, j),
+                                                 levelCols[0], sum);
+                    } else {
+                        pool_row_pair<Max, false>(row(k - 1, 2 * j), row(k - 1, 2 * j + 1), row(k, j),
+                                                  levelCols[k], sum);
+                    }
+                }
+            }
+        }
+
+        total += xs::reduce_add(sum.lanes1) + xs::reduce_add(sum.lanes2) + sum.tail;
+    }
+
+    const double mean = total / (4 * levelRows[0] * levelCols[0]);
+    const RemapLevels remapLevels = remap_levels(mean, dmin, mmult);
+    for(size_t k = 0; k < levels; k++) {
+        if(out[k] != nullptr) {
+            apply_remap(out[k], out[k], levelRows[k] * levelCols[k], remapLevels, accuracy);
+        }
+    }
+}
+
+void pyramid_remap_into(const float* in, size_t rows, size_t cols, size_t levels, PoolMode mode,
+                        float* const* out, int dmin, int mmult, Log10Accuracy accuracy) {
+    if(mode == PoolMode::Max) {
+        pyramid_remap_impl<true>(in, rows, cols, levels, out, dmin, mmult, accuracy);
+    } else {
+        pyramid_remap_impl<false>(in, rows, cols, levels, out, dmin, mmult, accuracy);
+    }
+}
+
+/**
+ * Box filter and remap in one pass. The filter is the mean of |x| over a
+ * window x window neighbourhood, over the part of it inside the frame near
+ * the edges. Threads take stripes of kFilterStripe rows. A stripe keeps
+ * running column sums over the window's rows, sliding down a row at a time
+ * (add the row entering, subtract the row leaving). Each output row then
+ * takes the horizontal window sums from a prefix sum of the column sums and
+ * is remapped straight away, while the row is still in cache. The prefix sum
+ * is scanned a register at a time, so the only serial dependency left is
+ * the carry from one register to the next.
+ */
+constexpr size_t kFilterStripe = 32;
+
+// prefix[c + 1] = columnSums[0] + ... + columnSums[c], in double
+void prefix_sums(const float* columnSums, double* prefix, size_t cols) {
+    constexpr size_t kHalf = kFloatLanes / 2;
+    prefix[0] = 0.0;
+    vec_pd carry = setzero_pd();
+    size_t c = 0;
+    for(; c + kFloatLanes <= cols; c += kFloatLanes) {
+        vec_pd lo, hi;
+        widen_ps(loadu_ps(&columnSums[c]), lo, hi);
+        storeu_pd(&prefix[c + 1], scan_pd(lo, carry));
+        storeu_pd(&prefix[c + 1 + kHalf], scan_pd(hi, carry));
+    }
+    for(; c < cols; c++) {
+        prefix[c + 1] = prefix[c] + columnSums[c];
+    }
+}
+
+// filtered[c] = (prefix[c + radius + 1] - prefix[c - radius]) * scale over
+// [first, last), the columns whose window is all inside the row
+void window_sums(const double* prefix, float* filtered, size_t first, size_t last, size_t radius, double scale) {
+    constexpr size_t kHalf = kFloatLanes / 2;
+    using dbatch = xs::batch<double>;
+    const dbatch vscale(scale);
+    size_t c = first;
+    for(; c + kFloatLanes <= last; c += kFloatLanes) {
+        const double* hi = &prefix[c + radius + 1];
+        const double* lo = &prefix[c - radius];
+        const dbatch low = (dbatch(loadu_pd(hi)) - dbatch(loadu_pd(lo))) * vscale;
+        const dbatch high = (dbatch(loadu_pd(hi + kHalf)) - dbatch(loadu_pd(lo + kHalf))) * vscale;
+        storeu_ps(&filtered[c], narrow_pd(low, high));
+    }
+    for(; c < last; c++) {
+        filtered[c] = (prefix[c + radius + 1] - prefix[c - radius]) * scale;
+    }
+}
+
+// columnSums[c] += |row[c]|, or -= with Subtract
+template <bool Subtract>
+void accumulate_abs_row(float* columnSums, const float* row, size_t cols) {
+    size_t c = 0;
+    for(; c + kFloatLanes <= cols; c += kFloatLanes) {
+        const vec_ps x = abs_ps(loadu_ps(&row[c]));
+        const xs::batch<float> sums = loadu_ps(&columnSums[c]);
+        storeu_ps(&columnSums[c], Subtract ? sums - xs::batch<float>(x) : sums + xs::batch<float>(x));
+    }
+    for(; c < cols; c++) {
+        columnSums[c] += Subtract ? -std::abs(row[c]) : std::abs(row[c]);
+    }
+}
+
+template <class Out>
+void filter_remap_impl(const float* in, size_t rows, size_t cols, size_t window, Out* out, int dmin, int mmult,
+                       Log10Accuracy accuracy) {
+    if(rows == 0 || cols == 0) {
+        return;
+    }
+
+    const size_t radius = window / 2;
+    // The box filter keeps the mean of the interior, the clip level comes
+    // from the unfiltered |x| like the other remaps
+    const double mean = magnitude_sum(in, rows * cols) / (rows * cols);
+    const size_t stripes = (rows + kFilterStripe - 1) / kFilterStripe;
+
+    with_remap_batch(remap_levels(mean, dmin, mmult), accuracy, [&](auto remapBatch) {
+        #pragma omp parallel
+        {
+            ScratchBuffer<float> columnSums(cols);
+            ScratchBuffer<float> filtered(cols);
+            ScratchBuffer<double> prefix(cols + 1);
+
+            #pragma omp for schedule(static)
+            for(size_t s = 0; s < stripes; s++) {
+                const size_t first = s * kFilterStripe;
+                const size_t last = std::min(first + kFilterStripe, rows);
+
+                // Column sums over the window of the stripe's first row, from
+                // scratch so float rounding cannot build up across stripes
+                std::fill(columnSums.data, columnSums.data + cols, 0.f);
+                for(size_t y = first > radius ? first - radius : 0; y <= std::min(rows - 1, first + radius); y++) {
+                    accumulate_abs_row<false>(columnSums.data, &in[y * cols], cols);
+                }
+
+                for(size_t y = first; y < last; y++) {
+                    if(y > first) {
+                        if(y + radius < rows) {
+                            accumulate_abs_row<false>(columnSums.data, &in[(y + radius) * cols], cols);
+                        }
+                        if(y > radius) {
+                            accumulate_abs_row<true>(columnSums.data, &in[(y - radius - 1) * cols], cols);
+                        }
+                    }
+                    const size_t top = y > radius ? y - radius : 0;
+                    const size_t windowRows = std::min(rows - 1, y + radius) - top + 1;
+
+                    prefix_sums(columnSums.data, prefix.data, cols);
+
+                    // Edge columns see part of the window, the interior all of it
+                    const size_t interiorFirst = std::min(radius, cols);
+                    const size_t interiorLast = cols > radius ? cols - radius : 0;
+                    const auto edge = [&](size_t c) {
+                        const size_t lo = c > radius ? c - radius : 0;
+                        const size_t hi = std::min(cols, c + radius + 1);
+                        filtered.data[c] = (prefix.data[hi] - prefix.data[lo]) / (windowRows * (hi - lo));
+                    };
+                    for(size_t c = 0; c < interiorFirst; c++) {
+                        edge(c);
+                    }
+                    if(interiorFirst < interiorLast) {
+                        window_sums(prefix.data, filtered.data, interiorFirst, interiorLast, radius,
+                                    1.0 / (windowRows * window));
+                    }
+                    for(size_t c = std::max(interiorFirst, interiorLast); c < cols; c++) {
+                        edge(c);
+                    }
+
+                    remap_row(filtered.data, &out[y * cols], cols, remapBatch);
+                }
+            }
+        }
+    });
+}
+
+void filter_remap_into(const float* in, size_t rows, size_t cols, size_t window, float* out, int dmin, int mmult,
+                       Log10Accuracy accuracy) {
+    filter_remap_impl(in, rows, cols, window, out, dmin, mmult, accuracy);
+}
+
+void filter_remap_u8_into(const float* in, size_t rows, size_t cols, size_t window, uint8_t* out, int dmin,
+                          int mmult, Log10Accuracy accuracy) {
+    filter_remap_impl(in, rows, cols, window, out, dmin, mmult, accuracy);
+}
+
+/**
+ * Per-row and per-column reductions of a row-major frame, in double.
+ */
+
+// out[r] = sum of row r. Each row is a dense abs-free version of _sum_avx2
+void reduce_rows_into(const float* data, size_t rows, size_t cols, double* out) {
+    #pragma omp parallel for schedule(static)
+    for(size_t r = 0; r < rows; r++) {
+        const float* row = &data[r * cols];
+        vec_pd acc1 = setzero_pd();
+        vec_pd acc2 = setzero_pd();
+
+        size_t c = 0;
+        for(; c + 2 * kFloatLanes <= cols; c += 2 * kFloatLanes) {
+            acc1 = add_widened(acc1, loadu_ps(&row[c]));
+            acc2 = add_widened(acc2, loadu_ps(&row[c + kFloatLanes]));
+        }
+        double total = hsum_pd(acc1) + hsum_pd(acc2);
+        for(; c < cols; c++) {
+            total += row[c];
+        }
+        out[r] = total;
+    }
+}
+
+// Rows of a stripe added into the column accumulators per trip, so the
+// accumulators go through memory once per kColRowBlock rows, not every row
+constexpr size_t kColRowBlock = 8;
+// Columns held in registers at once: four float registers, eight double ones
+constexpr size_t kColBlock = 4 * kFloatLanes;
+
+/**
+ * @brief acc[c] += sum of rows [0, n) of column c, for the columns in
+ * [0, width). Register-blocked: each block of kColBlock columns is loaded
+ * into double registers once, has n rows added to it, and is stored back.
+ */
+void accumulate_cols(const float* rows, size_t pitch, size_t n, double* acc, size_t width) {
+    using dbatch = xs::batch<double>;
+    constexpr size_t half = kFloatLanes / 2;
+
+    size_t c = 0;
+    for(; c + kColBlock <= width; c += kColBlock) {
+        dbatch sums[8];
+        for(size_t k = 0; k < 8; k++) {
+            sums[k] = dbatch::load_unaligned(&acc[c + k * half]);
+        }
+        for(size_t r = 0; r < n; r++) {
+            const float* row = &rows[r * pitch + c];
+            for(size_t k = 0; k < 4; k++) {
+                auto converted = xs::widen(xs::batch<float>(loadu_ps(&row[k * kFloatLanes])));
+                sums[2 * k] += converted[0];
+                sums[2 * k + 1] += converted[1];
+            }
+        }
+        for(size_t k = 0; k < 8; k++) {
+            sums[k].store_unaligned(&acc[c + k * half]);
+        }
+    }
+
+    for(; c < width; c++) {
+        double sum = acc[c];
+        for(size_t r = 0; r < n; r++) {
+            sum += rows[r * pitch + c];
+        }
+        acc[c] = sum;
+    }
+}
+
+/**
+ * @brief out[c] = sum of column c. Each thread takes a stripe of rows into
+ * its own column partials, kColRowBlock rows at a time, then the partials
+ * are merged column-parallel in thread order.
+ */
+void reduce_cols_into(const float* data, size_t rows, size_t cols, double* out) {
+    const size_t threads = omp_get_max_threads();
+    ScratchBuffer<double> partials(threads * cols);
+
+    #pragma omp parallel num_threads(threads)
+    {
+        const size_t team = omp_get_num_threads();
+        const size_t self = omp_get_thread_num();
+        const size_t first = self * rows / team;
+        const size_t last = (self + 1) * rows / team;
+
+        double* acc = &partials.data[self * cols];
+        std::fill(acc, acc + cols, 0.0);
+        for(size_t r = first; r < last; r += kColRowBlock) {
+            accumulate_cols(&data[r * cols], cols, std::min(kColRowBlock, last - r), acc, cols);
+        }
+
+        #pragma omp barrier
+
+        #pragma omp for schedule(static)
+        for(size_t c = 0; c < cols; c++) {
+            double sum = 0.0;
+            for(size_t t = 0; t < team; t++) {
+                sum += partials.data[t * cols + c];
+            }
+            out[c] = sum;
+        }
+    }
+}
+
+// Single-threaded pieces of the xsimd sum and remap, WorkPool runs one per chunk
+double chunk_abs_sum(const float* data, size_t size) {
+    return widened_sum<Magnitude<float>>(data, size, false);
+}
+
+void chunk_remap_with_mean(const float* data, float* remappedData, size_t size, double mean, int dmin, int mmult,
+                           Log10Accuracy accuracy) {
+    apply_remap(data, remappedData, size, remap_levels(mean, dmin, mmult), accuracy, false);
+}
+
+void chunk_remap_with_mean_u8(const float* data, uint8_t* remappedData, size_t size, double mean, int dmin,
+                              int mmult, Log10Accuracy accuracy) {
+    apply_remap_u8(data, remappedData, size, remap_levels(mean, dmin, mmult), accuracy, false);
+}
+
+// Upper bound on the LUT remap's table, 16 KB of floats stays resident in L1
+constexpr size_t kMaxLutEntries = 4096;
+
+/**
+ * @brief Remaps with a table lookup in place of log10. Positive floats order the
+ * same way as their bit patterns, and the remap saturates outside
+ * [x_lo, x_hi], so the key is the bit pattern of max(|x|, EPS) clamped to
+ * that range. The key is shifted down until the range fits in
+ * kMaxLutEntries buckets, which makes the index the float's exponent plus its
+ * top mantissa bits. Each bucket holds the midpoint of the remap over the
+ * bucket, so no output is further than half a bucket's rise from _remap.
+ *
+ * @param info If not null, receives the table size and the worst-case deviation
+ */
+void remap_avx2_xsimd_lut_into(const float* data, float* remappedData, size_t size, int dmin, int mmult,
+                               LutRemapInfo* info) {
+    using batch = xs::batch<float>;
+    using ibatch = xs::batch<int32_t>;
+    constexpr size_t simdWidth = batch::size;
+
+    const double mean = _sum_avx2_xsimd_omp(data, size) / size;
+    const auto [slope, constant] = remap_levels(mean, dmin, mmult);
+    const float EPS = 1e-5f;
+
+    const auto remapScalar = [=](float x) {
+        return std::clamp(slope * std::log10(x) + constant, 0.f, 255.f);
+    };
+    const auto bitsOf = [](float x) { return std::bit_cast<int32_t>(x); };
+
+    // Where the remap hits 0 and 255, the order depends on the sign of the slope
+    const float xA = std::pow(10.f, (0.f - constant) / slope);
+    const float xB = std::pow(10.f, (255.f - constant) / slope);
+    const int32_t keyLo = bitsOf(std::max(std::min(xA, xB), EPS));
+    const int32_t keyHi = std::max(bitsOf(std::max(std::max(xA, xB), EPS)), keyLo);
+
+    int shift = 0;
+    while((static_cast<int64_t>(keyHi - keyLo) >> shift) >= static_cast<int64_t>(kMaxLutEntries)) {
+        shift++;
+    }
+    const size_t tableSize = static_cast<size_t>((keyHi - keyLo) >> shift) + 1;
+
+    alignas(64) float table[kMaxLutEntries];
+    float maxDeviation = 0.f;
+    for(size_t j = 0; j < tableSize; j++) {
+        const int32_t first = keyLo + static_cast<int32_t>(j << shift);
+        const int32_t last = std::min<int64_t>(keyHi, first + (int64_t{1} << shift) - 1);
+        const float a = remapScalar(std::bit_cast<float>(first));
+        const float b = remapScalar(std::bit_cast<float>(last));
+        table[j] = 0.5f * (a + b);
+        maxDeviation = std::max(maxDeviation, 0.5f * std::abs(b - a));
+    }
+
+    if(info) {
+        info->tableSize = tableSize;
+        info->maxDeviation = maxDeviation;
+    }
+
+    const size_t vectorEnd = size - size % simdWidth;
+
+    #pragma omp parallel for
+    for(size_t i = 0; i < vectorEnd; i += simdWidth) {
+        auto v = xs::max(xs::abs(xs::load_unaligned(&data[i])), batch(EPS));
+        auto key = xs::min(xs::max(xs::bitwise_cast<int32_t>(v), ibatch(keyLo)), ibatch(keyHi));
+        auto index = (key - ibatch(keyLo)) >> shift;
+        batch::gather(table, index).store_unaligned(&remappedData[i]);
+    }
+
+    for(size_t i = vectorEnd; i < size; i++) {
+        const int32_t key = std::clamp(bitsOf(std::max(std::abs(data[i]), EPS)), keyLo, keyHi);
+        remappedData[i] = table[(key - keyLo) >> shift];
+    }
+}
+
+/**
+ * Count, mean and sum of squared deviations of a run of values. Two of these
+ * combine exactly (Chan et al.), so blocks and threads can be merged in any
+ * tree without the cancellation a sum-of-squares variance suffers.
+ */
+struct MomentState {
+    double count = 0.0;
+    double mean = 0.0;
+    double m2 = 0.0;
+
+    void merge(const MomentState& other) {
+        if(other.count == 0.0) {
+            return;
+        }
+        const double total = count + other.count;
+        const double delta = other.mean - mean;
+        mean += delta * (other.count / total);
+        m2 += other.m2 + delta * delta * (count * other.count / total);
+        count = total;
+    }
+};
+
+struct StatsPartial {
+    MomentState moments;
+    // Kept apart from moments.mean * count, which is rounded twice
+    double sum = 0.0;
+    double absSum = 0.0;
+    float min = std::numeric_limits<float>::infinity();
+    float max = -std::numeric_limits<float>::infinity();
+};
+
+// 8 KB of floats, the second look at a block comes out of L1
+constexpr size_t kStatsBlock = 2048;
+
+/**
+ * @brief Folds one block into partial. The first sweep gets the sum, abs-sum,
+ * min and max; the second sweep over the same, now cached, block gets the
+ * squared deviations from the block mean, which is then merged in.
+ */
+void accumulate_stats_block(const float* data, size_t n, StatsPartial& partial) {
+    using batch = xs::batch<float>;
+    using dbatch = xs::batch<double>;
+    constexpr size_t simdWidth = batch::size;
+    const size_t vectorEnd = n - n % simdWidth;
+
+    dbatch sum(0.0), absSum(0.0);
+    batch vmin(std::numeric_limits<float>::infinity());
+    batch vmax(-std::numeric_limits<float>::infinity());
+    for(size_t i = 0; i < vectorEnd; i += simdWidth) {
+        auto v = xs::load_unaligned(&data[i]);
+        auto wide = xs::widen(v);
+        sum += wide[0] + wide[1];
+        absSum += xs::abs(wide[0]) + xs::abs(wide[1]);
+        vmin = xs::min(vmin, v);
+        vmax = xs::max(vmax, v);
+    }
+
+    double blockSum = xs::reduce_add(sum);
+    double blockAbsSum = xs::reduce_add(absSum);
+    float blockMin = xs::reduce_min(vmin);
+    float blockMax = xs::reduce_max(vmax);
+    for(size_t i = vectorEnd; i < n; i++) {
+        blockSum += data[i];
+        blockAbsSum += std::abs(data[i]);
+        blockMin = std::min(blockMin, data[i]);
+        blockMax = std::max(blockMax, data[i]);
+    }
+
+    const double blockMean = blockSum / n;
+    dbatch m2(0.0);
+    for(size_t i = 0; i < vectorEnd; i += simdWidth) {
+        auto wide = xs::widen(xs::load_unaligned(&data[i]));
+        auto d0 = wide[0] - dbatch(blockMean);
+        auto d1 = wide[1] - dbatch(blockMean);
+        m2 = xs::fma(d0, d0, m2);
+        m2 = xs::fma(d1, d1, m2);
+    }
+
+    double blockM2 = xs::reduce_add(m2);
+    for(size_t i = vectorEnd; i < n; i++) {
+        const double d = data[i] - blockMean;
+        blockM2 += d * d;
+    }
+
+    partial.moments.merge({static_cast<double>(n), blockMean, blockM2});
+    partial.sum += blockSum;
+    partial.absSum += blockAbsSum;
+    partial.min = std::min(partial.min, blockMin);
+    partial.max = std::max(partial.max, blockMax);
+}
+
+/**
+ * @brief Sum, abs-sum, min, max, mean and variance of data in a single pass.
+ * Each thread folds its blocks into a partial, and the partials are merged
+ * in thread order afterwards.
+ */
+FrameStats reduce_stats(const float* data, size_t size) {
+    if(size == 0) {
+        const float nan = std::numeric_limits<float>::quiet_NaN();
+        return {0, 0.0, 0.0, nan, nan, nan, nan};
+    }
+
+    const size_t numBlocks = (size + kStatsBlock - 1) / kStatsBlock;
+    std::vector<StatsPartial> partials(omp_get_max_threads());
+
+    #pragma omp parallel
+    {
+        StatsPartial local;
+
+        #pragma omp for schedule(static) nowait
+        for(size_t b = 0; b < numBlocks; b++) {
+            const size_t begin = b * kStatsBlock;
+            accumulate_stats_block(&data[begin], std::min(kStatsBlock, size - begin), local);
+        }
+
+        partials[omp_get_thread_num()] = local;
+    }
+
+    StatsPartial total;
+    for(const auto& partial : partials) {
+        total.moments.merge(partial.moments);
+        total.sum += partial.sum;
+        total.absSum += partial.absSum;
+        total.min = std::min(total.min, partial.min);
+        total.max = std::max(total.max, partial.max);
+    }
+
+    const auto& moments = total.moments;
+    return {
+        size,
+        total.sum,
+        total.absSum,
+        total.min,
+        total.max,
+        moments.mean,
+        moments.m2 / moments.count,
+    };
+}
+
+// The deterministic sum gives every element a fixed place in a fixed-shape
+// tree: blocks of kDetBlock elements, kDetLanes double lanes per block
+// (element i feeds lane i % kDetLanes whatever the register width), then
+// pairwise trees over lanes and over blocks. Neither the thread count nor
+// the ISA build changes which additions happen in which order.
+constexpr size_t kDetBlock = 4096;
+constexpr size_t kDetLanes = 16;
+
+// Sums v[0, n) as a balanced tree whose shape only depends on n
+double pairwise_sum(const double* v, size_t n) {
+    if(n <= 4) {
+        double sum = 0.0;
+        for(size_t i = 0; i < n; i++) {
+            sum += v[i];
+        }
+        return sum;
+    }
+
+    const size_t half = n / 2;
+    return pairwise_sum(v, half) + pairwise_sum(v + half, n - half);
+}
+
+double deterministic_block_sum(const float* data, size_t n) {
+    using batch = xs::batch<float>;
+    using dbatch = xs::batch<double>;
+    constexpr size_t floatBatches = kDetLanes / batch::size;
+    constexpr size_t doubleBatches = kDetLanes / dbatch::size;
+    static_assert(kDetLanes % batch::size == 0, "the lane layout has to fill whole registers");
+
+    dbatch acc[doubleBatches];
+    for(auto& a : acc) {
+        a = dbatch(0.0);
+    }
+
+    size_t i = 0;
+    for(; i + kDetLanes <= n; i += kDetLanes) {
+        for(size_t k = 0; k < floatBatches; k++) {
+            auto wide = xs::widen(xs::load_unaligned(&data[i + k * batch::size]));
+            acc[2 * k] += wide[0];
+            acc[2 * k + 1] += wide[1];
+        }
+    }
+
+    alignas(64) double lanes[kDetLanes];
+    for(size_t k = 0; k < doubleBatches; k++) {
+        acc[k].store_aligned(&lanes[k * dbatch::size]);
+    }
+    for(size_t lane = 0; i < n; i++, lane++) {
+        lanes[lane] += data[i];
+    }
+
+    return pairwise_sum(lanes, kDetLanes);
+}
+
+/**
+ * @brief Sum of data that is bit-identical for any OpenMP thread count or
+ * schedule, and across the ISA builds. Blocks are summed in parallel into
+ * their own slots and the slots are combined with a fixed pairwise tree.
+ */
+double _sum_deterministic(const float* data, size_t size) {
+    const size_t numBlocks = (size + kDetBlock - 1) / kDetBlock;
+    std::vector<double> blockSums(numBlocks);
+
+    #pragma omp parallel for schedule(static)
+    for(size_t b = 0; b < numBlocks; b++) {
+        const size_t begin = b * kDetBlock;
+        blockSums[b] = deterministic_block_sum(&data[begin], std::min(kDetBlock, size - begin));
+    }
+
+    return pairwise_sum(blockSums.data(), numBlocks);
+}
+
+// The percentile remap histograms log2|x| with kHistSubBits bins per octave.
+// The bin of a positive float is just its bit pattern shifted down, so the
+// table covers every exponent.
+constexpr int kHistSubBits = 3;
+constexpr int kHistShift = 23 - kHistSubBits;
+constexpr size_t kHistBins = size_t{1} << (8 + kHistSubBits);
+// Elements counted into 32-bit bins before they are flushed to the 64-bit ones
+constexpr size_t kHistBlock = size_t{1} << 20;
+
+/**
+ * @brief Histogram of the bins of max(|x|, EPS). The bin indices are computed
+ * a register at a time, the increments go to two interleaved sub-histograms
+ * so neighbouring lanes hitting the same bin do not serialise on one counter.
+ * Each thread counts on its own and the histograms are summed at the end.
+ */
+void log_histogram(const float* data, size_t size, uint64_t* hist) {
+    using batch = xs::batch<float>;
+    constexpr size_t simdWidth = batch::size;
+    const float EPS = 1e-5f;
+
+    std::fill(hist, hist + kHistBins, 0);
+    const size_t numBlocks = (size + kHistBlock - 1) / kHistBlock;
+
+    #pragma omp parallel
+    {
+        std::vector<uint64_t> local(kHistBins, 0);
+        std::vector<uint32_t> sub(2 * kHistBins);
+
+        #pragma omp for schedule(static) nowait
+        for(size_t b = 0; b < numBlocks; b++) {
+            const float* block = &data[b * kHistBlock];
+            const size_t n = std::min(kHistBlock, size - b * kHistBlock);
+            const size_t vectorEnd = n - n % simdWidth;
+            std::fill(sub.begin(), sub.end(), 0);
+
+            alignas(64) int32_t bins[simdWidth];
+            for(size_t i = 0; i < vectorEnd; i += simdWidth) {
+                auto v = xs::max(xs::abs(xs::load_unaligned(&block[i])), batch(EPS));
+                (xs::bitwise_cast<int32_t>(v) >> kHistShift).store_aligned(bins);
+                for(size_t lane = 0; lane < simdWidth; lane++) {
+                    sub[(lane & 1) * kHistBins + bins[lane]]++;
+                }
+            }
+            for(size_t i = vectorEnd; i < n; i++) {
+                sub[std::bit_cast<int32_t>(std::max(std::abs(block[i]), EPS)) >> kHistShift]++;
+            }
+
+            for(size_t bin = 0; bin < kHistBins; bin++) {
+                local[bin] += sub[bin] + sub[kHistBins + bin];
+            }
+        }
+
+        #pragma omp critical
+        for(size_t bin = 0; bin < kHistBins; bin++) {
+            hist[bin] += local[bin];
+        }
+    }
+}
+
+// The magnitude below which a fraction p of the histogram falls, interpolated
+// geometrically inside the bin it lands in
+float histogram_percentile(const uint64_t* hist, size_t total, float p) {
+    const double target = std::clamp(p, 0.f, 1.f) * static_cast<double>(total);
+
+    double below = 0.0;
+    size_t bin = 0;
+    for(; bin < kHistBins - 1; bin++) {
+        if(hist[bin] > 0 && below + hist[bin] >= target) {
+            break;
+        }
+        below += hist[bin];
+    }
+
+    const double frac = hist[bin] ? std::clamp((target - below) / hist[bin], 0.0, 1.0) : 0.0;
+    const float lower = std::bit_cast<float>(static_cast<int32_t>(bin << kHistShift));
+    const float upper = std::bit_cast<float>(static_cast<int32_t>((bin + 1) << kHistShift));
+    return lower * std::pow(upper / lower, static_cast<float>(frac));
+}
+
+/**
+ * @brief Remap with the clip levels taken from the magnitude distribution
+ * instead of the mean. C_L is the lowPercentile magnitude and maps to dmin,
+ * C_H is the highPercentile magnitude, capped at mmult * C_L, and maps to
+ * 255. The histogram pass takes the place of the mean pass, so this is still
+ * two streaming passes.
+ */
+void remap_percentile_into(const float* data, float* remappedData, size_t size, int dmin, int mmult,
+                           float lowPercentile, float highPercentile, ClipLevels* levels,
+                           Log10Accuracy accuracy) {
+    // No percentiles of nothing: the clip levels would come out NaN
+    if(size == 0) {
+        return;
+    }
+
+    std::vector<uint64_t> hist(kHistBins);
+    log_histogram(data, size, hist.data());
+
+    const float C_L = histogram_percentile(hist.data(), size, lowPercentile);
+    float C_H = std::min(histogram_percentile(hist.data(), size, highPercentile), mmult * C_L);
+    // A flat frame would otherwise give a zero-width range
+    C_H = std::max(C_H, C_L * 1.001f);
+
+    const float slope = (255 - dmin) / (std::log10(C_H) - std::log10(C_L));
+    const float constant = dmin - (slope * std::log10(C_L));
+
+    if(levels) {
+        levels->low = C_L;
+        levels->high = C_H;
+    }
+
+    apply_remap(data, remappedData, size, {slope, constant}, accuracy);
+}
+
+} // namespace
+} // namespace SUM_KERNEL_NAMESPACE
+
+namespace sum_detail {
+
+using namespace SUM_KERNEL_NAMESPACE;
+
+const KernelTable SUM_KERNEL_TABLE = {
+    SUM_KERNEL_NAME,
+    _sum_avx2,
+    _sum_avx2_omp,
+    _sum_avx2_xsimd_omp,
+    _sum_deterministic,
+    _remap_into,
+    remap_avx2_scalar_log10_into,
+    remap_avx2_xsimd_into<float>,
+    remap_avx2_xsimd_u8_into<float>,
+    remap_avx2_xsimd_lut_into,
+    remap_percentile_into,
+    reduce_stats,
+    {magnitude_sum<std::complex<float>>, remap_avx2_xsimd_into<std::complex<float>>,
+     remap_avx2_xsimd_u8_into<std::complex<float>>},
+    {magnitude_sum<int16_t>, remap_avx2_xsimd_into<int16_t>, remap_avx2_xsimd_u8_into<int16_t>},
+    {magnitude_sum<Float16>, remap_avx2_xsimd_into<Float16>, remap_avx2_xsimd_u8_into<Float16>},
+    {magnitude_sum<BFloat16>, remap_avx2_xsimd_into<BFloat16>, remap_avx2_xsimd_u8_into<BFloat16>},
+    value_sum<Float16>,
+    value_sum<BFloat16>,
+    remap_with_mean_into,
+    remap_with_mean_u8_into,
+    {chunk_abs_sum, chunk_remap_with_mean, chunk_remap_with_mean_u8},
+    remap_fused_into,
+    remap_fused_u8_into,
+    roi_abs_sum,
+    remap_roi_into,
+    remap_roi_u8_into,
+    pyramid_remap_into,
+    filter_remap_into,
+    filter_remap_u8_into,
+    reduce_rows_into,
+    reduce_cols_into,
+    sum_squares,
+    dot,
+};
+
+} // namespace sum_detail
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+
+#include "SumTypes.hpp"
+
+/**
+ * Internal interface between the public entry points in Sum.cpp and the
+ * per-ISA builds of SumKernels.cpp. SumKernels.cpp is compiled once for
+ * each instruction set below and each build exports one KernelTable;
+ * Sum.cpp picks the best table the CPU supports once, at load time.
+ *
+ * Each build is its own shared library (see CMakeLists.txt). Its code is in
+ * an anonymous namespace inside a namespace named after its ISA, and
+ * SumKernels.map keeps every other symbol local, the inline std templates
+ * the kernels instantiate included, so the table is all it exports and a
+ * build never runs another build's copy of anything.
+ */
+namespace sum_detail {
+
+enum class Isa {
+    SSE42,
+    AVX2,
+    AVX512
+};
+
+// The magnitude kernels for one non-float input sample type
+template <class T>
+struct SampleKernels {
+    double (*sum_xsimd)(const T* data, size_t size);
+    void (*remap_xsimd)(const T* data, float* out, size_t size, int dmin, int mmult, Log10Accuracy accuracy);
+    void (*remap_xsimd_u8)(const T* data, uint8_t* out, size_t size, int dmin, int mmult,
+                           Log10Accuracy accuracy);
+};
+
+// The same loops on the calling thread only, no OpenMP team. WorkPool calls
+// them once per chunk
+struct ChunkKernels {
+    double (*abs_sum)(const float* data, size_t size);
+    void (*remap_with_mean)(const float* data, float* out, size_t size, double mean, int dmin, int mmult,
+                            Log10Accuracy accuracy);
+    void (*remap_with_mean_u8)(const float* data, uint8_t* out, size_t size, double mean, int dmin, int mmult,
+                               Log10Accuracy accuracy);
+};
+
+// Deepest preview pyramid pyramid_remap builds
+constexpr size_t kMaxPyramidLevels = 16;
+
+struct KernelTable {
+    const char* name;
+
+    double (*sum_avx2)(const float* __restrict__ data, size_t dataSize);
+    double (*sum_avx2_omp)(const float* __restrict__ data, size_t dataSize);
+    double (*sum_avx2_xsimd_omp)(const float* __restrict__ data, size_t dataSize);
+    double (*sum_deterministic)(const float* data, size_t dataSize);
+
+    // The remaps write into caller-owned memory, "out" may alias "data"
+    void (*remap)(const float* data, float* out, size_t size, int dmin, int mmult);
+    void (*remap_avx2_scalar_log10)(const float* data, float* out, size_t size, int dmin, int mmult);
+    void (*remap_avx2_xsimd)(const float* data, float* out, size_t size, int dmin, int mmult,
+                             Log10Accuracy accuracy);
+    void (*remap_avx2_xsimd_u8)(const float* data, uint8_t* out, size_t size, int dmin, int mmult,
+                                Log10Accuracy accuracy);
+    void (*remap_avx2_xsimd_lut)(const float* data, float* out, size_t size, int dmin, int mmult,
+                                 LutRemapInfo* info);
+    void (*remap_percentile)(const float* data, float* out, size_t size, int dmin, int mmult,
+                             float lowPercentile, float highPercentile, ClipLevels* levels,
+                             Log10Accuracy accuracy);
+
+    FrameStats (*reduce_stats)(const float* data, size_t size);
+
+    SampleKernels<std::complex<float>> complex_samples;
+    SampleKernels<int16_t> int16_samples;
+    SampleKernels<Float16> float16_samples;
+    SampleKernels<BFloat16> bfloat16_samples;
+
+    // Signed sums of the 16-bit float formats
+    double (*sum_float16)(const Float16* data, size_t size);
+    double (*sum_bfloat16)(const BFloat16* data, size_t size);
+
+    // The xsimd remap with the mean supplied rather than computed from "data"
+    void (*remap_with_mean)(const float* data, float* out, size_t size, double mean, int dmin, int mmult,
+                            Log10Accuracy accuracy);
+    void (*remap_with_mean_u8)(const float* data, uint8_t* out, size_t size, double mean, int dmin, int mmult,
+                               Log10Accuracy accuracy);
+
+    ChunkKernels chunk;
+
+    // remap_with_mean that also returns the sum of |x| over "data", from the
+    // same single read of it
+    double (*remap_fused)(const float* data, float* out, size_t size, double mean, int dmin, int mmult,
+                          Log10Accuracy accuracy);
+    double (*remap_fused_u8)(const float* data, uint8_t* out, size_t size, double mean, int dmin, int mmult,
+                             Log10Accuracy accuracy);
+
+    // A width x height region of a pitched image, pitches in elements
+    double (*roi_abs_sum)(const float* in, size_t inPitch, size_t width, size_t height);
+    void (*remap_roi)(const float* in, size_t inPitch, float* out, size_t outPitch, size_t width, size_t height,
+                      int dmin, int mmult, Log10Accuracy accuracy);
+    void (*remap_roi_u8)(const float* in, size_t inPitch, uint8_t* out, size_t outPitch, size_t width,
+                         size_t height, int dmin, int mmult, Log10Accuracy accuracy);
+
+    // Pools levels 1..levels of a preview pyramid of a rows x cols frame and
+    // remaps level k into out[k], (rows >> (k + 1)) x (cols >> (k + 1)).
+    // Levels with a null out[k] are pooled through but not kept
+    void (*pyramid_remap)(const float* in, size_t rows, size_t cols, size_t levels, PoolMode mode,
+                          float* const* out, int dmin, int mmult, Log10Accuracy accuracy);
+
+    // Box filter of |x| over a window x window neighbourhood, then the remap.
+    // "out" must not alias "in"
+    void (*filter_remap)(const float* in, size_t rows, size_t cols, size_t window, float* out, int dmin,
+                         int mmult, Log10Accuracy accuracy);
+    void (*filter_remap_u8)(const float* in, size_t rows, size_t cols, size_t window, uint8_t* out, int dmin,
+                            int mmult, Log10Accuracy accuracy);
+
+    // Sum of each row into out[rows], of each column into out[cols]
+    void (*reduce_rows)(const float* data, size_t rows, size_t cols, double* out);
+    void (*reduce_cols)(const float* data, size_t rows, size_t cols, double* out);
+
+    // Sum of x * x, and of a[i] * b[i], accumulated in double
+    double (*sum_squares)(const float* data, size_t size);
+    double (*dot)(const float* a, const float* b, size_t size);
+};
+
+extern const KernelTable sse42_kernels;
+extern const KernelTable avx2_kernels;
+extern const KernelTable avx512_kernels;
+
+bool isa_supported(Isa isa);
+const KernelTable& kernels_for(Isa isa);
+const KernelTable& active_kernels();
+
+} // namespace sum_detail
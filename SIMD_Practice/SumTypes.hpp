@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Types shared by the public API in Sum.hpp and the per-ISA kernels, kept apart
+ * so the kernels do not have to see the public function declarations.
+ */
+
+/**
+ * How the vectorized remaps evaluate log10. The error figures are the largest
+ * absolute error in log10(x) over the normal floats; the remapped value is off
+ * by at most |slope| times that.
+ *
+ * - Exact: xsimd's log10, within a couple of ulp of std::log10. The 8-bit
+ *   remaps use std::log10 itself, so they match _remap rounded exactly.
+ * - Fast: degree 5 polynomial, 1e-5 absolute (1e-4 relative once |log10(x)| > 0.1).
+ * - Display8Bit: degree 3 polynomial, 8e-4 absolute. Stays under half an
+ *   output level for any |slope| below 600, which is all an 8-bit display
+ *   can show.
+ */
+enum class Log10Accuracy {
+    Exact,
+    Fast,
+    Display8Bit
+};
+
+/**
+ * What the LUT remap built for a call. maxDeviation is the largest difference
+ * any input can see between the table and the exact remap, in output levels.
+ */
+struct LutRemapInfo {
+    size_t tableSize;
+    float maxDeviation;
+};
+
+/**
+ * The clip levels a remap chose: "low" (C_L) maps to dmin and "high" (C_H)
+ * maps to 255.
+ */
+struct ClipLevels {
+    float low;
+    float high;
+};
+
+/**
+ * Everything the QA stage wants to know about a frame, from one pass over it.
+ * variance is the population variance.
+ */
+struct FrameStats {
+    size_t count;
+    double sum;
+    double absSum;
+    float min;
+    float max;
+    double mean;
+    double variance;
+};
+
+/**
+ * 16-bit float samples as archived, just the bits. Float16 is IEEE binary16,
+ * BFloat16 is the top half of a float. The kernels widen them to float as
+ * they load.
+ */
+struct Float16 {
+    uint16_t bits;
+};
+
+struct BFloat16 {
+    uint16_t bits;
+};
+
+/**
+ * A region of interest in a pitched image, in elements: columns x to
+ * x + width, rows y to y + height.
+ */
+struct Roi {
+    size_t x;
+    size_t y;
+    size_t width;
+    size_t height;
+};
+
+// How the preview pyramid pools a block of |x|: the mean, or the max so that
+// point targets stay visible when zoomed out
+enum class PoolMode {
+    Box,
+    Max
+};
+
+// What reduce_rows and reduce_cols return per row or column
+enum class AxisStat {
+    Sum,
+    Mean
+};
@@ -0,0 +1,308 @@
+#include "WorkPool.hpp"
+#include "SumKernels.hpp"
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <cassert> // assert macro
+#include <type_traits>
+
+#include <pthread.h>
+#include <sched.h>
+
+namespace {
+
+// Which pool, if any, the current thread works for, and its index there
+thread_local const WorkPool* t_pool = nullptr;
+thread_local unsigned t_self = 0;
+
+// One span per chunk run, see Trace.hpp
+const trace::Region g_traceSumChunk("pool_sum_chunk");
+const trace::Region g_traceRemapChunk("pool_remap_chunk");
+
+// The CPUs this process may run on, in order
+std::vector<int> allowed_cpus() {
+    std::vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if(sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for(int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if(CPU_ISSET(cpu, &set)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+    if(cpus.empty()) {
+        cpus.push_back(-1);
+    }
+    return cpus;
+}
+
+size_t chunk_count(size_t size) {
+    return (size + kPoolChunk - 1) / kPoolChunk;
+}
+
+/**
+ * @brief The abs-sum of a frame. Each chunk writes its own partial and the
+ * last one to finish adds them up in chunk order and fulfils the promise.
+ */
+class SumJob final : public PoolJob {
+public:
+    explicit SumJob(std::span<const float> data)
+        : m_data(data), m_partials(chunk_count(data.size())), m_pending(m_partials.size()) {}
+
+    std::future<double> start(WorkPool& pool) {
+        auto future = m_result.get_future();
+        if(m_partials.empty()) {
+            m_result.set_value(0.0);
+            delete this;
+        } else {
+            pool.submit(*this, m_partials.size());
+        }
+        return future;
+    }
+
+    void run(WorkPool&, size_t chunk) override {
+        const size_t first = chunk * kPoolChunk;
+        const size_t n = std::min(kPoolChunk, m_data.size() - first);
+        {
+            trace::Span span(g_traceSumChunk);
+            m_partials[chunk] = sum_detail::active_kernels().chunk.abs_sum(&m_data[first], n);
+        }
+
+        if(m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            double total = 0.0;
+            for(double partial : m_partials) {
+                total += partial;
+            }
+            m_result.set_value(total);
+            delete this;
+        }
+    }
+
+private:
+    std::span<const float> m_data;
+    std::vector<double> m_partials;
+    std::atomic<size_t> m_pending;
+    std::promise<double> m_result;
+};
+
+/**
+ * @brief The xsimd remap of a frame in two rounds of chunks. The last sum
+ * chunk works out the mean and queues the remap chunks itself, so there is
+ * no point where the pool waits for the frame as a whole.
+ */
+template <class Out>
+class RemapJob final : public PoolJob {
+public:
+    RemapJob(std::span<const float> in, std::span<Out> out, int dmin, int mmult, Log10Accuracy accuracy)
+        : m_in(in), m_out(out), m_dmin(dmin), m_mmult(mmult), m_accuracy(accuracy),
+          m_partials(chunk_count(in.size())), m_pending(m_partials.size()) {}
+
+    std::future<void> start(WorkPool& pool) {
+        auto future = m_done.get_future();
+        if(m_partials.empty()) {
+            m_done.set_value();
+            delete this;
+        } else {
+            pool.submit(*this, m_partials.size());
+        }
+        return future;
+    }
+
+    void run(WorkPool& pool, size_t chunk) override {
+        const auto& kernels = sum_detail::active_kernels().chunk;
+        const size_t first = chunk * kPoolChunk;
+        const size_t n = std::min(kPoolChunk, m_in.size() - first);
+
+        if(!m_remapping) {
+            {
+                trace::Span span(g_traceSumChunk);
+                m_partials[chunk] = kernels.abs_sum(&m_in[first], n);
+            }
+            if(m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                double total = 0.0;
+                for(double partial : m_partials) {
+                    total += partial;
+                }
+                m_mean = total / m_in.size();
+                m_remapping = true;
+                m_pending.store(m_partials.size(), std::memory_order_relaxed);
+                // The worker deques' mutexes publish m_mean and m_remapping
+                // to whoever runs the remap chunks
+                pool.submit(*this, m_partials.size());
+            }
+            return;
+        }
+
+        {
+            trace::Span span(g_traceRemapChunk);
+            if constexpr(std::is_same_v<Out, uint8_t>) {
+                kernels.remap_with_mean_u8(&m_in[first], &m_out[first], n, m_mean, m_dmin, m_mmult, m_accuracy);
+            } else {
+                kernels.remap_with_mean(&m_in[first], &m_out[first], n, m_mean, m_dmin, m_mmult, m_accuracy);
+            }
+        }
+
+        if(m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            m_done.set_value();
+            delete this;
+        }
+    }
+
+private:
+    std::span<const float> m_in;
+    std::span<Out> m_out;
+    int m_dmin;
+    int m_mmult;
+    Log10Accuracy m_accuracy;
+
+    std::vector<double> m_partials;
+    std::atomic<size_t> m_pending;
+    double m_mean = 0.0;
+    bool m_remapping = false;
+    std::promise<void> m_done;
+};
+
+} // namespace
+
+WorkPool::WorkPool(unsigned threads, bool pin) {
+    const std::vector<int> cpus = allowed_cpus();
+    if(threads == 0) {
+        threads = static_cast<unsigned>(cpus.size());
+    }
+
+    for(unsigned i = 0; i < threads; i++) {
+        m_workers.push_back(std::make_unique<Worker>());
+    }
+    // Started only once every Worker exists, they steal from each other
+    for(unsigned i = 0; i < threads; i++) {
+        const int cpu = pin ? cpus[i % cpus.size()] : -1;
+        m_workers[i]->thread = std::thread([this, i, cpu] { work(i, cpu); });
+    }
+}
+
+WorkPool::~WorkPool() {
+    {
+        std::lock_guard lock(m_sleepMutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+
+    for(auto& worker : m_workers) {
+        worker->thread.join();
+    }
+}
+
+void WorkPool::submit(PoolJob& job, size_t chunks) {
+    if(chunks == 0) {
+        return;
+    }
+
+    // Counted before they are visible, so a quick thief cannot take the
+    // count below zero
+    m_queued.fetch_add(chunks, std::memory_order_release);
+
+    if(t_pool == this) {
+        // Continuations stay on the submitting worker, the chunks it just
+        // summed are still in its cache
+        Worker& self = *m_workers[t_self];
+        std::lock_guard lock(self.mutex);
+        for(size_t c = 0; c < chunks; c++) {
+            self.tasks.push_back({&job, c});
+        }
+    } else {
+        // Contiguous runs of chunks per worker, like a static schedule
+        const size_t workers = m_workers.size();
+        const unsigned start = m_nextVictim.fetch_add(1, std::memory_order_relaxed);
+        for(size_t w = 0; w < workers; w++) {
+            const size_t first = w * chunks / workers;
+            const size_t last = (w + 1) * chunks / workers;
+            if(first == last) {
+                continue;
+            }
+            Worker& worker = *m_workers[(start + w) % workers];
+            std::lock_guard lock(worker.mutex);
+            for(size_t c = first; c < last; c++) {
+                worker.tasks.push_back({&job, c});
+            }
+        }
+    }
+
+    {
+        // Taking the lock orders this with a worker about to sleep, so the
+        // wake-up cannot be lost
+        std::lock_guard lock(m_sleepMutex);
+    }
+    m_wake.notify_all();
+}
+
+bool WorkPool::try_pop(unsigned self, Task& task) {
+    // Our own work first, oldest first
+    {
+        Worker& own = *m_workers[self];
+        std::lock_guard lock(own.mutex);
+        if(!own.tasks.empty()) {
+            task = own.tasks.front();
+            own.tasks.pop_front();
+            m_queued.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    // Then steal from the far end of someone else's
+    const size_t workers = m_workers.size();
+    for(size_t offset = 1; offset < workers; offset++) {
+        Worker& victim = *m_workers[(self + offset) % workers];
+        std::lock_guard lock(victim.mutex);
+        if(!victim.tasks.empty()) {
+            task = victim.tasks.back();
+            victim.tasks.pop_back();
+            m_queued.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void WorkPool::work(unsigned self, int cpu) {
+    if(cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        // Best effort, an unpinned worker still works
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+    t_pool = this;
+    t_self = self;
+
+    Task task;
+    for(;;) {
+        if(try_pop(self, task)) {
+            task.job->run(*this, task.chunk);
+            continue;
+        }
+
+        std::unique_lock lock(m_sleepMutex);
+        m_wake.wait(lock, [&] { return m_stop || m_queued.load(std::memory_order_acquire) > 0; });
+        if(m_stop && m_queued.load(std::memory_order_acquire) == 0) {
+            return;
+        }
+    }
+}
+
+std::future<double> sum_xsimd_async(WorkPool& pool, std::span<const float> data) {
+    return (new SumJob(data))->start(pool);
+}
+
+std::future<void> remap_xsimd_async(WorkPool& pool, std::span<const float> in, std::span<float> out, int dmin,
+                                    int mmult, Log10Accuracy accuracy) {
+    assert(in.size() == out.size());
+    return (new RemapJob<float>(in, out, dmin, mmult, accuracy))->start(pool);
+}
+
+std::future<void> remap_xsimd_u8_async(WorkPool& pool, std::span<const float> in, std::span<uint8_t> out,
+                                       int dmin, int mmult, Log10Accuracy accuracy) {
+    assert(in.size() == out.size());
+    return (new RemapJob<uint8_t>(in, out, dmin, mmult, accuracy))->start(pool);
+}
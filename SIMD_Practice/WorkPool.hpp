@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include "SumTypes.hpp"
+
+/**
+ * An alternative to the per-call OpenMP regions for frame loops running
+ * mid-sized frames at high rates, where fork/join and the barriers at the
+ * end of every region are a visible part of each call.
+ *
+ * The workers are started once and, optionally, pinned one per CPU. Work is
+ * submitted as chunks of a PoolJob; each worker runs chunks from its own
+ * deque and steals from the others when it runs dry. Nothing ever waits for
+ * the whole pool: a job's last chunk submits whatever comes next (the remap
+ * after the mean), so the chunks of consecutive frames interleave freely.
+ */
+
+class WorkPool;
+
+// Work split into chunks. run is called once per chunk, on any worker
+class PoolJob {
+public:
+    virtual ~PoolJob() = default;
+    virtual void run(WorkPool& pool, size_t chunk) = 0;
+};
+
+class WorkPool {
+public:
+    // threads == 0 uses one worker per CPU this process may run on
+    explicit WorkPool(unsigned threads = 0, bool pin = true);
+    ~WorkPool();
+
+    WorkPool(const WorkPool&) = delete;
+    WorkPool& operator=(const WorkPool&) = delete;
+
+    unsigned size() const { return static_cast<unsigned>(m_workers.size()); }
+
+    // Queues chunks [0, chunks) of job. From a worker they go on its own
+    // deque, from any other thread they are dealt out across the workers.
+    // The job must outlive its chunks
+    void submit(PoolJob& job, size_t chunks);
+
+private:
+    struct Task {
+        PoolJob* job;
+        size_t chunk;
+    };
+
+    struct alignas(64) Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        std::thread thread;
+    };
+
+    void work(unsigned self, int cpu);
+    bool try_pop(unsigned self, Task& task);
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::atomic<size_t> m_queued{0};
+    std::atomic<unsigned> m_nextVictim{0};
+    std::mutex m_sleepMutex;
+    std::condition_variable m_wake;
+    bool m_stop = false;
+};
+
+// Chunk size of the pool kernels below, in elements. 128 KB of floats, so a
+// chunk's input stays in L2 between the sum and the remap
+constexpr size_t kPoolChunk = size_t{1} << 15;
+
+// The xsimd abs-sum and remaps on a WorkPool. The spans must stay valid until
+// the future is ready. The sum adds the chunks' partial sums in chunk order,
+// so it is the same for any pool size
+std::future<double> sum_xsimd_async(WorkPool& pool, std::span<const float> data);
+std::future<void> remap_xsimd_async(WorkPool& pool, std::span<const float> in, std::span<float> out, int dmin,
+                                    int mmult, Log10Accuracy accuracy = Log10Accuracy::Exact);
+std::future<void> remap_xsimd_u8_async(WorkPool& pool, std::span<const float> in, std::span<uint8_t> out,
+                                       int dmin, int mmult, Log10Accuracy accuracy = Log10Accuracy::Exact);
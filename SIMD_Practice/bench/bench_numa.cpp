@@ -0,0 +1,109 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <span>
+#include <string>
+
+#include <omp.h>
+
+#include "Numa.hpp"
+#include "Stopwatch.hpp"
+#include "Sum.hpp"
+
+/**
+ * Memory bandwidth of the abs-sum and the xsimd remap per socket, and over
+ * the whole host with and without NUMA placement.
+ *
+ * usage: bench_numa [megabytes per buffer, default 1024]
+ */
+
+namespace {
+
+constexpr int kRepetitions = 10;
+
+struct Result {
+    double sumGBs;
+    double remapGBs;
+};
+
+// Best of kRepetitions, bytes moved over seconds
+template <class F>
+double best_gbs(size_t bytes, F&& f) {
+    double best = 1e30;
+    for(int i = 0; i < kRepetitions; i++) {
+        Stopwatch sw;
+        sw.start();
+        f();
+        sw.stop();
+        best = std::min(best, sw.elapsed());
+    }
+    return bytes / best / 1e9;
+}
+
+// placed: first-touch both buffers with the kernels' partition, otherwise
+// the main thread touches everything, as a plain serial fill would
+Result run(size_t size, bool placed) {
+    std::unique_ptr<float[]> in(new float[size]);
+    std::unique_ptr<float[]> out(new float[size]);
+
+    if(placed) {
+        numa_first_touch(in.get(), size * sizeof(float));
+        numa_first_touch(out.get(), size * sizeof(float));
+        #pragma omp parallel for schedule(static)
+        for(size_t i = 0; i < size; i++) {
+            in[i] = static_cast<float>(i % 1000) - 500.f;
+        }
+    } else {
+        for(size_t i = 0; i < size; i++) {
+            in[i] = static_cast<float>(i % 1000) - 500.f;
+            out[i] = 0.f;
+        }
+    }
+
+    Result result;
+    result.sumGBs = best_gbs(size * sizeof(float), [&] { _sum_avx2_xsimd_omp(in.get(), size); });
+    // The remap reads the input twice (mean, remap) and writes the output once
+    result.remapGBs = best_gbs(3 * size * sizeof(float), [&] {
+        remap_avx2_xsimd_into(std::span<const float>(in.get(), size), std::span<float>(out.get(), size), 60, 40);
+    });
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const size_t megabytes = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1024;
+    const size_t size = megabytes * (size_t{1} << 20) / sizeof(float);
+    const auto& nodes = numa_topology().nodeCpus;
+
+    std::cout << "ISA " << sum_active_isa() << ", " << nodes.size() << " node(s), " << megabytes
+              << " MB per buffer, best of " << kRepetitions << std::endl;
+
+    // One socket at a time, its own threads on its own memory
+    for(size_t node = 0; node < nodes.size(); node++) {
+        omp_set_num_threads(static_cast<int>(nodes[node].size()));
+        numa_pin_omp_threads(static_cast<int>(node));
+        const Result r = run(size, true);
+        std::cout << "node " << node << " (" << nodes[node].size() << " CPUs): sum " << r.sumGBs
+                  << " GB/s, remap " << r.remapGBs << " GB/s" << std::endl;
+    }
+
+    // Every socket, placed against not placed
+    size_t cpus = 0;
+    for(const auto& node : nodes) {
+        cpus += node.size();
+    }
+    omp_set_num_threads(static_cast<int>(cpus));
+    numa_pin_omp_threads();
+
+    const Result naive = run(size, false);
+    std::cout << "all nodes, serial first touch: sum " << naive.sumGBs << " GB/s, remap " << naive.remapGBs
+              << " GB/s" << std::endl;
+
+    const Result placed = run(size, true);
+    std::cout << "all nodes, NUMA placed:        sum " << placed.sumGBs << " GB/s, remap " << placed.remapGBs
+              << " GB/s (" << placed.sumGBs / nodes.size() << " GB/s per socket)" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,358 @@
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <omp.h>
+
+#include "Sum.hpp"
+
+/**
+ * Throughput of every _sum_* and remap_* entry point over a sweep of buffer
+ * sizes, from L1-resident to DRAM-sized, and of OpenMP team sizes. Each point
+ * reports bytes/s and elements/s as the mean, median and stddev of
+ * kRepetitions runs. For numbers to diff between releases:
+ *
+ *   bench_sum --benchmark_out=bench_sum.json --benchmark_out_format=json
+ *
+ * --benchmark_filter=<regex> picks kernels, e.g. "remap_avx2_xsimd_into/".
+ * Benchmark names are kernel/input bytes/threads.
+ */
+
+namespace {
+
+constexpr int kRepetitions = 5;
+constexpr int kDmin = 60;
+constexpr int kMmult = 40;
+
+// Input bytes: L1, L2, a slice of L3, and two sizes well past any L3
+const std::vector<int64_t> kSizes = {
+    int64_t{32} << 10, int64_t{256} << 10, int64_t{4} << 20, int64_t{64} << 20, int64_t{256} << 20};
+
+// 1, 2, 4, ... OpenMP threads, and every CPU if that is not a power of two
+std::vector<int64_t> thread_counts() {
+    const int cpus = omp_get_num_procs();
+    std::vector<int64_t> counts;
+    for(int t = 1; t < cpus; t *= 2) {
+        counts.push_back(t);
+    }
+    counts.push_back(cpus);
+    return counts;
+}
+
+// The same data on every run and every host: a fixed-seed xorshift, not
+// std::random_device, mapped to roughly [-1000, 1000)
+uint32_t next_random(uint32_t& state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+float random_float(uint32_t& state) {
+    return static_cast<float>(next_random(state) >> 8) * (2000.f / (1 << 24)) - 1000.f;
+}
+
+template <class T>
+T random_sample(uint32_t& state) {
+    if constexpr(std::is_same_v<T, std::complex<float>>) {
+        const float i = random_float(state);
+        return {i, random_float(state)};
+    } else if constexpr(std::is_same_v<T, int16_t>) {
+        return static_cast<int16_t>(next_random(state));
+    } else if constexpr(std::is_same_v<T, BFloat16>) {
+        return {static_cast<uint16_t>(std::bit_cast<uint32_t>(random_float(state)) >> 16)};
+    } else if constexpr(std::is_same_v<T, Float16>) {
+        // Sign, an exponent for roughly [2^-5, 2^5), any mantissa
+        const uint32_t r = next_random(state);
+        const uint16_t exponent = static_cast<uint16_t>(10 + (r >> 16) % 10);
+        return {static_cast<uint16_t>((r & 0x8000) | (exponent << 10) | (r & 0x3ff))};
+    } else {
+        return random_float(state);
+    }
+}
+
+// Filled by the threads of a static schedule, as the kernels read it, so the
+// pages sit on the right nodes
+template <class T>
+AlignedBuffer<T> make_input(size_t count) {
+    AlignedBuffer<T> data(count);
+    #pragma omp parallel
+    {
+        uint32_t state = 0x9e3779b9u + 7919u * static_cast<uint32_t>(omp_get_thread_num());
+        #pragma omp for schedule(static)
+        for(size_t i = 0; i < count; i++) {
+            data[i] = random_sample<T>(state);
+        }
+    }
+    return data;
+}
+
+template <class T>
+AlignedBuffer<T> make_output(size_t count) {
+    AlignedBuffer<T> out(count);
+    #pragma omp parallel for schedule(static)
+    for(size_t i = 0; i < count; i++) {
+        out[i] = T{};
+    }
+    return out;
+}
+
+struct Point {
+    size_t bytes;
+    int threads;
+};
+
+Point setup(benchmark::State& state) {
+    const Point point{static_cast<size_t>(state.range(0)), static_cast<int>(state.range(1))};
+    omp_set_num_threads(point.threads);
+    return point;
+}
+
+// Square-ish frames for the 2-D kernels: cols a power of two, rows to fit
+struct Shape {
+    size_t rows;
+    size_t cols;
+};
+
+Shape shape_of(size_t count) {
+    const size_t cols = std::max<size_t>(64, std::bit_floor(static_cast<size_t>(std::sqrt(count))));
+    return {count / cols, cols};
+}
+
+// All of the frame but a 16 column margin, so the pitch is not the width
+Roi roi_of(Shape shape) {
+    return {16, 0, shape.cols - 16, shape.rows};
+}
+
+// How many of a buffer's elements a kernel touches, for the kernels that
+// work on a frame or a region of it rather than the whole buffer
+using Footprint = size_t (*)(size_t count);
+
+size_t whole(size_t count) {
+    return count;
+}
+
+size_t frame_of(size_t count) {
+    const Shape shape = shape_of(count);
+    return shape.rows * shape.cols;
+}
+
+size_t roi_area(size_t count) {
+    const Roi roi = roi_of(shape_of(count));
+    return roi.width * roi.height;
+}
+
+// reads counts passes over the input: two for most remaps (the mean, then
+// the remap), one for a sum or a remap given its mean
+void report(benchmark::State& state, size_t count, size_t inBytes, size_t outBytes, int reads) {
+    const auto iterations = static_cast<int64_t>(state.iterations());
+    state.SetItemsProcessed(iterations * static_cast<int64_t>(count));
+    state.SetBytesProcessed(iterations * static_cast<int64_t>(reads * inBytes + outBytes));
+}
+
+// A sum of T over the input, sum(data, count), that reads the part of it
+// given by "touched"
+template <class T, class F>
+void bench_sum(benchmark::State& state, F sum, Footprint touched = whole) {
+    const Point point = setup(state);
+    const size_t count = point.bytes / sizeof(T);
+    auto in = make_input<T>(count);
+
+    for(auto _ : state) {
+        benchmark::DoNotOptimize(sum(in.data(), count));
+    }
+    const size_t elements = touched(count);
+    report(state, elements, elements * sizeof(T), 0, 1);
+}
+
+// A remap of T into Out, remap(in span, out span), making "reads" passes
+// over the part of the input given by "touchedIn" and writing "touchedOut"
+// of the output. A decimation writes fewer elements than it reads
+template <class T, class Out, class F>
+void bench_remap(benchmark::State& state, F remap, int reads = 2, Footprint touchedIn = whole,
+                 Footprint touchedOut = whole) {
+    const Point point = setup(state);
+    const size_t count = point.bytes / sizeof(T);
+    auto in = make_input<T>(count);
+    auto out = make_output<Out>(count);
+
+    for(auto _ : state) {
+        remap(std::span<const T>(in.data(), count), std::span<Out>(out.data(), count));
+        benchmark::ClobberMemory();
+    }
+    const size_t elements = touchedIn(count);
+    report(state, elements, elements * sizeof(T), touchedOut(count) * sizeof(Out), reads);
+}
+
+// A remap that allocates its output, through the buffer pool
+template <class F>
+void bench_allocating_remap(benchmark::State& state, F remap) {
+    const Point point = setup(state);
+    const size_t count = point.bytes / sizeof(float);
+    auto in = make_input<float>(count);
+
+    for(auto _ : state) {
+        auto out = remap(in.data(), count);
+        benchmark::DoNotOptimize(out.data());
+    }
+    report(state, count, count * sizeof(float), count * sizeof(float), 2);
+}
+
+using Body = std::function<void(benchmark::State&)>;
+
+void add(const std::string& name, Body body) {
+    benchmark::RegisterBenchmark(name.c_str(), [body](benchmark::State& state) { body(state); })
+        ->ArgsProduct({kSizes, thread_counts()})
+        ->ArgNames({"bytes", "threads"})
+        ->Repetitions(kRepetitions)
+        ->ReportAggregatesOnly(true)
+        ->UseRealTime()
+        ->Unit(benchmark::kMicrosecond);
+}
+
+void register_sums() {
+    add("_sum_avx2", [](auto& s) { bench_sum<float>(s, [](float* d, size_t n) { return _sum_avx2(d, n); }); });
+    add("_sum_avx2_omp",
+        [](auto& s) { bench_sum<float>(s, [](float* d, size_t n) { return _sum_avx2_omp(d, n); }); });
+    add("_sum_avx2_xsimd_omp",
+        [](auto& s) { bench_sum<float>(s, [](float* d, size_t n) { return _sum_avx2_xsimd_omp(d, n); }); });
+    add("_sum_avx2_xsimd_omp<complex>", [](auto& s) {
+        bench_sum<std::complex<float>>(s, [](const std::complex<float>* d, size_t n) {
+            return _sum_avx2_xsimd_omp(d, n);
+        });
+    });
+    add("_sum_avx2_xsimd_omp<int16>", [](auto& s) {
+        bench_sum<int16_t>(s, [](const int16_t* d, size_t n) { return _sum_avx2_xsimd_omp(d, n); });
+    });
+    add("_sum_avx2_xsimd_omp<fp16>", [](auto& s) {
+        bench_sum<Float16>(s, [](const Float16* d, size_t n) { return _sum_avx2_xsimd_omp(d, n); });
+    });
+    add("_sum_avx2_xsimd_omp<bf16>", [](auto& s) {
+        bench_sum<BFloat16>(s, [](const BFloat16* d, size_t n) { return _sum_avx2_xsimd_omp(d, n); });
+    });
+    add("_sum_avx2_omp<fp16>", [](auto& s) {
+        bench_sum<Float16>(s, [](const Float16* d, size_t n) { return _sum_avx2_omp(d, n); });
+    });
+    add("_sum_avx2_omp<bf16>", [](auto& s) {
+        bench_sum<BFloat16>(s, [](const BFloat16* d, size_t n) { return _sum_avx2_omp(d, n); });
+    });
+    add("_sum_deterministic", [](auto& s) {
+        bench_sum<float>(s, [](const float* d, size_t n) { return _sum_deterministic({d, n}); });
+    });
+    add("_sum_squares", [](auto& s) {
+        bench_sum<float>(s, [](const float* d, size_t n) { return _sum_squares({d, n}); });
+    });
+    // Both halves of the buffer, so the bytes read match the other sums
+    add("_dot", [](auto& s) {
+        bench_sum<float>(s, [](const float* d, size_t n) { return _dot({d, n / 2}, {d + n / 2, n / 2}); });
+    });
+    add("_sum_avx2_xsimd_roi", [](auto& s) {
+        bench_sum<float>(s, [](const float* d, size_t n) {
+            const Shape shape = shape_of(n);
+            return _sum_avx2_xsimd_roi(d, shape.cols, roi_of(shape));
+        }, roi_area);
+    });
+}
+
+void register_remaps() {
+    add("_remap_into", [](auto& s) {
+        bench_remap<float, float>(s, [](auto in, auto out) { _remap_into(in, out, kDmin, kMmult); });
+    });
+    add("remap_avx2_scalar_log10_into", [](auto& s) {
+        bench_remap<float, float>(s, [](auto in, auto out) {
+            remap_avx2_scalar_log10_into(in, out, kDmin, kMmult);
+        });
+    });
+    add("remap_avx2_xsimd_into", [](auto& s) {
+        bench_remap<float, float>(s, [](auto in, auto out) { remap_avx2_xsimd_into(in, out, kDmin, kMmult); });
+    });
+    add("remap_avx2_xsimd_into<fast>", [](auto& s) {
+        bench_remap<float, float>(s, [](auto in, auto out) {
+            remap_avx2_xsimd_into(in, out, kDmin, kMmult, Log10Accuracy::Fast);
+        });
+    });
+    add("remap_avx2_xsimd_u8_into", [](auto& s) {
+        bench_remap<float, uint8_t>(s, [](auto in, auto out) {
+            remap_avx2_xsimd_u8_into(in, out, kDmin, kMmult);
+        });
+    });
+    add("remap_avx2_xsimd_lut_into", [](auto& s) {
+        bench_remap<float, float>(s, [](auto in, auto out) { remap_avx2_xsimd_lut_into(in, out, kDmin, kMmult); });
+    });
+    add("remap_percentile_into", [](auto& s) {
+        bench_remap<float, float>(s, [](auto in, auto out) { remap_percentile_into(in, out, kDmin, kMmult); });
+    });
+    add("remap_avx2_xsimd_with_mean_into", [](auto& s) {
+        bench_remap<float, float>(s, [](auto in, auto out) {
+            remap_avx2_xsimd_with_mean_into(in, out, 100.0, kDmin, kMmult);
+        }, 1);
+    });
+    add("remap_avx2_xsimd_into<complex>", [](auto& s) {
+        bench_remap<std::complex<float>, float>(s, [](auto in, auto out) {
+            remap_avx2_xsimd_into(in, out, kDmin, kMmult);
+        });
+    });
+    add("remap_avx2_xsimd_into<int16>", [](auto& s) {
+        bench_remap<int16_t, float>(s, [](auto in, auto out) { remap_avx2_xsimd_into(in, out, kDmin, kMmult); });
+    });
+    add("remap_avx2_xsimd_into<fp16>", [](auto& s) {
+        bench_remap<Float16, float>(s, [](auto in, auto out) { remap_avx2_xsimd_into(in, out, kDmin, kMmult); });
+    });
+    add("remap_avx2_xsimd_into<bf16>", [](auto& s) {
+        bench_remap<BFloat16, float>(s, [](auto in, auto out) { remap_avx2_xsimd_into(in, out, kDmin, kMmult); });
+    });
+    add("remap_avx2_xsimd_roi_into", [](auto& s) {
+        bench_remap<float, float>(s, [](auto in, auto out) {
+            const Shape shape = shape_of(in.size());
+            const Roi roi = roi_of(shape);
+            remap_avx2_xsimd_roi_into(in.data(), shape.cols, roi, out.data(), roi.width, kDmin, kMmult);
+        }, 2, roi_area, roi_area);
+    });
+    add("decimate_remap_into", [](auto& s) {
+        bench_remap<float, float>(s, [](auto in, auto out) {
+            const Shape shape = shape_of(in.size());
+            decimate_remap_into(in.first(shape.rows * shape.cols), shape.rows, shape.cols, 4, PoolMode::Box,
+                                out.first((shape.rows / 4) * (shape.cols / 4)), kDmin, kMmult);
+        }, 1, frame_of, [](size_t n) {
+            const Shape shape = shape_of(n);
+            return (shape.rows / 4) * (shape.cols / 4);
+        });
+    });
+    add("filter_remap_into", [](auto& s) {
+        bench_remap<float, float>(s, [](auto in, auto out) {
+            const Shape shape = shape_of(in.size());
+            const size_t n = shape.rows * shape.cols;
+            filter_remap_into(in.first(n), shape.rows, shape.cols, 5, out.first(n), kDmin, kMmult);
+        }, 2, frame_of, frame_of);
+    });
+    add("remap_avx2_xsimd", [](auto& s) {
+        bench_allocating_remap(s, [](const float* d, size_t n) {
+            return remap_avx2_xsimd(d, kDmin, kMmult, 1, static_cast<int>(n));
+        });
+    });
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    benchmark::Initialize(&argc, argv);
+    if(benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::AddCustomContext("isa", sum_active_isa());
+
+    register_sums();
+    register_remaps();
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
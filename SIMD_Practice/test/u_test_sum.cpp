@@ -1,11 +1,31 @@
 #include <gtest/gtest.h>
+#include <atomic>
+#include <bit>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
 #include <random>
+#include <omp.h>
+#include <sched.h>
 #include <xsimd/xsimd.hpp>
 
 namespace xs = xsimd;
 
 #include "Sum.hpp"
+#include "StreamRemap.hpp"
+#include "BatchRemap.hpp"
+#include "WorkPool.hpp"
+#include "Remapper.hpp"
+#include "Numa.hpp"
+#include "SumKernels.hpp"
 #include "Stopwatch.hpp"
+#include "PerfStopwatch.hpp"
+#include "Trace.hpp"
 
 TEST(Sum, Avx2Sum) {
     std::random_device rd;
@@ -69,17 +89,17 @@ TEST(Sum, Avx2Remap) {
     Stopwatch watch;
 
     watch.start();
-    float* nonVectorRemap = _remap(example.data(), dmin, mmult, rows, cols);
+    auto nonVectorRemap = _remap(example.data(), dmin, mmult, rows, cols);
     watch.stop();
     std::cout << "The gold test took " << watch.elapsed() << "\n";
 
     watch.start();
-    float* vectorRemap = remap_avx2_scalar_log10(example.data(), dmin, mmult, rows, cols);
+    auto vectorRemap = remap_avx2_scalar_log10(example.data(), dmin, mmult, rows, cols);
     watch.stop();
     std::cout << "The vectorized test took " << watch.elapsed() << "\n";
 
     watch.start();
-    float* xsimd_vectorRemap = remap_avx2_xsimd(example.data(), dmin, mmult, rows, cols);
+    auto xsimd_vectorRemap = remap_avx2_xsimd(example.data(), dmin, mmult, rows, cols);
     watch.stop();
     std::cout << "The XSIMD test took " << watch.elapsed() << "\n";
 
@@ -92,10 +112,1418 @@ TEST(Sum, Avx2Remap) {
     //         // EXPECT_FLOAT_EQ(nonVectorRemap[idx], xsimd_vectorRemap[idx]);
     //     }
     // }
+}
+
+TEST(Sum, DispatchBuildsAgree) {
+    using sum_detail::Isa;
+
+    // Deliberately not a multiple of any vector width so the tails get exercised
+    const int rows = 333;
+    const int cols = 301;
+    const size_t size = rows * cols;
+
+    std::mt19937 gen(1234);
+    std::uniform_real_distribution<> dis(-2.f, 2.f);
+
+    std::vector<float> example(size, 0.f);
+    for(auto& val : example) {
+        val = dis(gen);
+    }
+
+    double goldSum = 0.0;
+    double goldAbsSum = 0.0;
+    for(const auto& val : example) {
+        goldSum += val;
+        goldAbsSum += std::abs(val);
+    }
+
+    constexpr int dmin = 60;
+    constexpr int mmult = 40;
+    const auto& reference = sum_detail::kernels_for(Isa::SSE42);
+    std::vector<float> goldRemap(size);
+    reference.remap(example.data(), goldRemap.data(), size, dmin, mmult);
+
+    std::cout << "The active kernel build is " << sum_active_isa() << "\n";
+
+    for(const auto isa : {Isa::SSE42, Isa::AVX2, Isa::AVX512}) {
+        if(!sum_detail::isa_supported(isa)) {
+            continue;
+        }
+
+        const auto& kernels = sum_detail::kernels_for(isa);
+        SCOPED_TRACE(kernels.name);
+
+        EXPECT_NEAR(goldSum, kernels.sum_avx2(example.data(), size), 1e-6);
+        EXPECT_NEAR(goldSum, kernels.sum_avx2_omp(example.data(), size), 1e-6);
+        EXPECT_NEAR(goldAbsSum, kernels.sum_avx2_xsimd_omp(example.data(), size), 1e-6);
+
+        for(const auto remap : {kernels.remap, kernels.remap_avx2_scalar_log10}) {
+            std::vector<float> remapped(size);
+            remap(example.data(), remapped.data(), size, dmin, mmult);
+
+            for(size_t i = 0; i < size; i++) {
+                ASSERT_NEAR(goldRemap[i], remapped[i], 1e-2f) << "at index " << i;
+            }
+        }
+
+        std::vector<float> remapped(size);
+        kernels.remap_avx2_xsimd(example.data(), remapped.data(), size, dmin, mmult, Log10Accuracy::Exact);
+        for(size_t i = 0; i < size; i++) {
+            ASSERT_NEAR(goldRemap[i], remapped[i], 1e-2f) << "at index " << i;
+        }
+    }
+}
+
+TEST(Sum, RemapIntoReusedBuffer) {
+    const int rows = 257;
+    const int cols = 129;
+    const size_t size = rows * cols;
+
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<> dis(1.f, 2.f);
+
+    std::vector<float> example(size, 0.f);
+    for(auto& val : example) {
+        val = dis(gen);
+    }
+
+    constexpr int dmin = 60;
+    constexpr int mmult = 40;
+
+    const auto gold = remap_avx2_xsimd(example.data(), dmin, mmult, rows, cols);
+
+    // One output buffer reused across "frames"
+    std::vector<float> out(size, -1.f);
+    for(int frame = 0; frame < 3; frame++) {
+        remap_avx2_xsimd_into(example, out, dmin, mmult);
+        for(size_t i = 0; i < size; i++) {
+            ASSERT_FLOAT_EQ(gold[i], out[i]) << "at index " << i;
+        }
+    }
+
+    std::vector<float> inPlace(example);
+    remap_avx2_xsimd_inplace(inPlace, dmin, mmult);
+    for(size_t i = 0; i < size; i++) {
+        ASSERT_FLOAT_EQ(gold[i], inPlace[i]) << "at index " << i;
+    }
+
+    inPlace = example;
+    _remap_inplace(inPlace, dmin, mmult);
+    std::vector<float> scalarInPlace(example);
+    remap_avx2_scalar_log10_inplace(scalarInPlace, dmin, mmult);
+    _remap_into(example, out, dmin, mmult);
+    for(size_t i = 0; i < size; i++) {
+        ASSERT_FLOAT_EQ(out[i], inPlace[i]) << "at index " << i;
+        ASSERT_NEAR(out[i], scalarInPlace[i], 1e-2f) << "at index " << i;
+    }
+}
+
+TEST(Sum, RemapU8MatchesRoundedRemap) {
+    using sum_detail::Isa;
+
+    // Not a multiple of the 4-register step so the scalar tail runs too
+    const int rows = 401;
+    const int cols = 203;
+    const size_t size = rows * cols;
+
+    std::mt19937 gen(7);
+    std::uniform_real_distribution<> dis(-2.f, 2.f);
+
+    std::vector<float> example(size, 0.f);
+    for(auto& val : example) {
+        val = dis(gen);
+    }
+
+    constexpr int dmin = 60;
+    constexpr int mmult = 40;
+
+    std::vector<float> gold(size);
+    _remap_into(example, gold, dmin, mmult);
+
+    for(const auto isa : {Isa::SSE42, Isa::AVX2, Isa::AVX512}) {
+        if(!sum_detail::isa_supported(isa)) {
+            continue;
+        }
+
+        const auto& kernels = sum_detail::kernels_for(isa);
+        SCOPED_TRACE(kernels.name);
+
+        std::vector<uint8_t> remapped(size);
+        kernels.remap_avx2_xsimd_u8(example.data(), remapped.data(), size, dmin, mmult, Log10Accuracy::Exact);
+
+        for(size_t i = 0; i < size; i++) {
+            ASSERT_EQ(static_cast<uint8_t>(std::nearbyint(gold[i])), remapped[i]) << "at index " << i;
+        }
+    }
+
+    const auto allocated = remap_avx2_xsimd_u8(example.data(), dmin, mmult, rows, cols);
+    for(size_t i = 0; i < size; i++) {
+        ASSERT_EQ(static_cast<uint8_t>(std::nearbyint(gold[i])), allocated[i]) << "at index " << i;
+    }
+}
+
+TEST(Sum, RemapLog10AccuracyTiers) {
+    using sum_detail::Isa;
+
+    const int rows = 512;
+    const int cols = 509;
+    const size_t size = rows * cols;
+
+    // Log-uniform magnitudes so every exponent the polynomial sees gets hit
+    std::mt19937 gen(99);
+    std::uniform_real_distribution<> dis(-2.f, 4.f);
+
+    std::vector<float> example(size, 0.f);
+    for(auto& val : example) {
+        val = std::pow(10.f, dis(gen));
+    }
+
+    constexpr int dmin = 60;
+    constexpr int mmult = 40;
+
+    std::vector<float> gold(size);
+    _remap_into(example, gold, dmin, mmult);
+
+    double mean = 0.0;
+    for(const auto& val : example) {
+        mean += std::abs(val);
+    }
+    const float C_L = 0.8f * (mean / size);
+    const float slope = std::abs((255 - dmin) / std::log10(C_L));
+
+    // The documented worst-case log10 error of each tier, see SumTypes.hpp
+    const std::pair<Log10Accuracy, float> tiers[] = {
+        {Log10Accuracy::Exact, 1e-6f},
+        {Log10Accuracy::Fast, 1e-5f},
+        {Log10Accuracy::Display8Bit, 8e-4f},
+    };
+
+    for(const auto isa : {Isa::SSE42, Isa::AVX2, Isa::AVX512}) {
+        if(!sum_detail::isa_supported(isa)) {
+            continue;
+        }
+
+        const auto& kernels = sum_detail::kernels_for(isa);
+        SCOPED_TRACE(kernels.name);
+
+        for(const auto& [accuracy, log10Bound] : tiers) {
+            std::vector<float> remapped(size);
+            kernels.remap_avx2_xsimd(example.data(), remapped.data(), size, dmin, mmult, accuracy);
+
+            float maxError = 0.f;
+            for(size_t i = 0; i < size; i++) {
+                maxError = std::max(maxError, std::abs(gold[i] - remapped[i]));
+            }
+
+            std::cout << kernels.name << " tier " << static_cast<int>(accuracy) << " max error against _remap "
+                      << maxError << " (bound " << slope * log10Bound << ")\n";
+            EXPECT_LE(maxError, slope * log10Bound + 1e-3f);
+        }
+    }
+}
+
+TEST(Sum, RemapLutDeviation) {
+    using sum_detail::Isa;
+
+    const int rows = 300;
+    const int cols = 333;
+    const size_t size = rows * cols;
+
+    std::mt19937 gen(5);
+    std::uniform_real_distribution<> dis(-2.f, 4.f);
+
+    std::vector<float> example(size, 0.f);
+    for(auto& val : example) {
+        val = std::pow(10.f, dis(gen));
+    }
+
+    constexpr int dmin = 60;
+    constexpr int mmult = 40;
+
+    std::vector<float> gold(size);
+    _remap_into(example, gold, dmin, mmult);
+
+    for(const auto isa : {Isa::SSE42, Isa::AVX2, Isa::AVX512}) {
+        if(!sum_detail::isa_supported(isa)) {
+            continue;
+        }
+
+        const auto& kernels = sum_detail::kernels_for(isa);
+        SCOPED_TRACE(kernels.name);
+
+        LutRemapInfo info{};
+        std::vector<float> remapped(size);
+        kernels.remap_avx2_xsimd_lut(example.data(), remapped.data(), size, dmin, mmult, &info);
+
+        float maxError = 0.f;
+        for(size_t i = 0; i < size; i++) {
+            maxError = std::max(maxError, std::abs(gold[i] - remapped[i]));
+        }
+
+        std::cout << kernels.name << " LUT of " << info.tableSize << " entries, reported deviation "
+                  << info.maxDeviation << ", measured " << maxError << "\n";
+        EXPECT_GT(info.tableSize, 0UL);
+        EXPECT_LE(info.tableSize, 4096UL);
+        EXPECT_LE(maxError, info.maxDeviation + 1e-3f);
+    }
+}
+
+TEST(Sum, ReduceStatsOnePass) {
+    using sum_detail::Isa;
+
+    const size_t size = 1000003;
+
+    std::mt19937 gen(11);
+    std::normal_distribution<> dis(1000.f, 3.f);
+
+    // A large offset with a small spread is where a naive sum-of-squares
+    // variance falls apart
+    std::vector<float> example(size, 0.f);
+    for(auto& val : example) {
+        val = dis(gen);
+    }
+    example[17] = -5.f;
+
+    double goldSum = 0.0;
+    double goldAbsSum = 0.0;
+    float goldMin = example[0];
+    float goldMax = example[0];
+    for(const auto& val : example) {
+        goldSum += val;
+        goldAbsSum += std::abs(val);
+        goldMin = std::min(goldMin, val);
+        goldMax = std::max(goldMax, val);
+    }
+    const double goldMean = goldSum / size;
+    double goldVariance = 0.0;
+    for(const auto& val : example) {
+        goldVariance += (val - goldMean) * (val - goldMean);
+    }
+    goldVariance /= size;
+
+    for(const auto isa : {Isa::SSE42, Isa::AVX2, Isa::AVX512}) {
+        if(!sum_detail::isa_supported(isa)) {
+            continue;
+        }
+
+        const auto& kernels = sum_detail::kernels_for(isa);
+        SCOPED_TRACE(kernels.name);
+
+        const FrameStats stats = kernels.reduce_stats(example.data(), size);
+        EXPECT_EQ(size, stats.count);
+        EXPECT_NEAR(goldSum, stats.sum, 1e-6 * std::abs(goldSum));
+        EXPECT_NEAR(goldAbsSum, stats.absSum, 1e-6 * goldAbsSum);
+        EXPECT_EQ(goldMin, stats.min);
+        EXPECT_EQ(goldMax, stats.max);
+        EXPECT_NEAR(goldMean, stats.mean, 1e-9 * std::abs(goldMean));
+        EXPECT_NEAR(goldVariance, stats.variance, 1e-9 * goldVariance);
+    }
+
+    // The exact block sums, not mean * count, so they agree with the plain
+    // sums to double rounding
+    const FrameStats stats = reduce_stats(example);
+    EXPECT_NEAR(_sum_avx2_omp(example.data(), size), stats.sum, 1e-12 * goldAbsSum);
+    EXPECT_NEAR(_sum_avx2_xsimd_omp(example.data(), size), stats.absSum, 1e-12 * goldAbsSum);
+
+    const FrameStats empty = reduce_stats({});
+    EXPECT_EQ(0UL, empty.count);
+}
+
+TEST(Sum, DeterministicSumIgnoresThreadCount) {
+    using sum_detail::Isa;
+
+    const size_t size = 3000017;
+
+    std::mt19937 gen(3);
+    std::uniform_real_distribution<> dis(-1e3f, 1e3f);
+
+    std::vector<float> example(size, 0.f);
+    for(auto& val : example) {
+        val = dis(gen);
+    }
+
+    long double goldSum = 0.0L;
+    for(const auto& val : example) {
+        goldSum += val;
+    }
+
+    const int maxThreads = omp_get_max_threads();
+    const double reference = sum_detail::kernels_for(Isa::SSE42).sum_deterministic(example.data(), size);
+    EXPECT_NEAR(static_cast<double>(goldSum), reference, 1e-9 * std::abs(static_cast<double>(goldSum)));
+
+    for(const auto isa : {Isa::SSE42, Isa::AVX2, Isa::AVX512}) {
+        if(!sum_detail::isa_supported(isa)) {
+            continue;
+        }
+
+        const auto& kernels = sum_detail::kernels_for(isa);
+        SCOPED_TRACE(kernels.name);
+
+        for(const int threads : {1, 2, 3, 7, 16}) {
+            omp_set_num_threads(threads);
+            EXPECT_EQ(reference, kernels.sum_deterministic(example.data(), size)) << threads << " threads";
+        }
+    }
+
+    omp_set_num_threads(maxThreads);
+}
+
+TEST(Sum, RemapPercentileClipLevels) {
+    using sum_detail::Isa;
+
+    const int rows = 700;
+    const int cols = 701;
+    const size_t size = rows * cols;
+
+    // Log-uniform clutter between 1 and 100 plus a few very bright scatterers
+    // that would drag a mean-based C_L up by an order of magnitude
+    std::mt19937 gen(21);
+    std::uniform_real_distribution<> dis(0.f, 2.f);
+    std::vector<float> example(size, 0.f);
+    for(size_t i = 0; i < size; i++) {
+        example[i] = (i % 1000 == 0) ? 1e6f : std::pow(10.f, dis(gen));
+    }
+
+    std::vector<float> sorted(example);
+    std::nth_element(sorted.begin(), sorted.begin() + size / 2, sorted.end());
+    const float median = sorted[size / 2];
+    const size_t p99Index = static_cast<size_t>(0.99 * size);
+    std::nth_element(sorted.begin(), sorted.begin() + p99Index, sorted.end());
+    const float p99 = sorted[p99Index];
+
+    constexpr int dmin = 60;
+    constexpr int mmult = 40;
+
+    for(const auto isa : {Isa::SSE42, Isa::AVX2, Isa::AVX512}) {
+        if(!sum_detail::isa_supported(isa)) {
+            continue;
+        }
+
+        const auto& kernels = sum_detail::kernels_for(isa);
+        SCOPED_TRACE(kernels.name);
+
+        ClipLevels levels{};
+        std::vector<float> remapped(size);
+        kernels.remap_percentile(example.data(), remapped.data(), size, dmin, mmult, 0.5f, 0.99f, &levels,
+                                 Log10Accuracy::Exact);
+
+        std::cout << kernels.name << " C_L " << levels.low << " (median " << median << "), C_H "
+                  << levels.high << " (p99 " << p99 << ")\n";
+
+        // Eight bins per octave, so within 9% of the true percentile
+        EXPECT_NEAR(median, levels.low, 0.09f * median);
+        EXPECT_NEAR(p99, levels.high, 0.09f * p99);
+        EXPECT_LE(levels.high, mmult * levels.low);
+
+        const float slope = (255 - dmin) / (std::log10(levels.high) - std::log10(levels.low));
+        const float constant = dmin - slope * std::log10(levels.low);
+        for(size_t i = 0; i < size; i++) {
+            const float expected = std::clamp(slope * std::log10(example[i]) + constant, 0.f, 255.f);
+            ASSERT_NEAR(expected, remapped[i], 1e-3f) << "at index " << i;
+        }
+    }
+
+    // A tight mmult caps C_H
+    ClipLevels capped{};
+    std::vector<float> remapped(size);
+    remap_percentile_into(example, remapped, dmin, 2, 0.5f, 0.99f, &capped);
+    EXPECT_FLOAT_EQ(2 * capped.low, capped.high);
+
+    // An empty frame leaves the levels alone rather than making them NaN
+    ClipLevels untouched{1.f, 2.f};
+    remap_percentile_into({}, {}, dmin, mmult, 0.5f, 0.999f, &untouched);
+    EXPECT_EQ(1.f, untouched.low);
+    EXPECT_EQ(2.f, untouched.high);
+}
+
+TEST(Sum, RemapComplexAndInt16Inputs) {
+    using sum_detail::Isa;
+
+    const size_t size = 200003;
+
+    std::mt19937 gen(8);
+    std::uniform_real_distribution<> dis(-3.f, 3.f);
+    std::uniform_int_distribution<int> idis(-32768, 32767);
+
+    std::vector<std::complex<float>> iq(size);
+    std::vector<float> iqMagnitude(size);
+    std::vector<int16_t> samples(size);
+    std::vector<float> widened(size);
+    for(size_t i = 0; i < size; i++) {
+        iq[i] = {static_cast<float>(dis(gen)), static_cast<float>(dis(gen))};
+        iqMagnitude[i] = std::sqrt(iq[i].real() * iq[i].real() + iq[i].imag() * iq[i].imag());
+        samples[i] = static_cast<int16_t>(idis(gen));
+        widened[i] = samples[i];
+    }
+
+    constexpr int dmin = 60;
+    constexpr int mmult = 40;
+
+    // The fused paths have to match converting to float first
+    std::vector<float> goldIq(size), goldSamples(size);
+    std::vector<uint8_t> goldIqU8(size), goldSamplesU8(size);
+    remap_avx2_xsimd_into(iqMagnitude, goldIq, dmin, mmult);
+    remap_avx2_xsimd_into(widened, goldSamples, dmin, mmult);
+    remap_avx2_xsimd_u8_into(iqMagnitude, goldIqU8, dmin, mmult);
+    remap_avx2_xsimd_u8_into(widened, goldSamplesU8, dmin, mmult);
+
+    for(const auto isa : {Isa::SSE42, Isa::AVX2, Isa::AVX512}) {
+        if(!sum_detail::isa_supported(isa)) {
+            continue;
+        }
+
+        const auto& kernels = sum_detail::kernels_for(isa);
+        SCOPED_TRACE(kernels.name);
+
+        EXPECT_NEAR(_sum_avx2_xsimd_omp(iqMagnitude.data(), size),
+                    kernels.complex_samples.sum_xsimd(iq.data(), size), 1e-6 * size);
+        EXPECT_NEAR(_sum_avx2_xsimd_omp(widened.data(), size),
+                    kernels.int16_samples.sum_xsimd(samples.data(), size), 1e-9 * size);
+
+        std::vector<float> remapped(size);
+        std::vector<uint8_t> remappedU8(size);
+
+        kernels.complex_samples.remap_xsimd(iq.data(), remapped.data(), size, dmin, mmult, Log10Accuracy::Exact);
+        kernels.complex_samples.remap_xsimd_u8(iq.data(), remappedU8.data(), size, dmin, mmult,
+                                               Log10Accuracy::Exact);
+        for(size_t i = 0; i < size; i++) {
+            ASSERT_NEAR(goldIq[i], remapped[i], 1e-2f) << "at index " << i;
+            ASSERT_NEAR(goldIqU8[i], remappedU8[i], 1) << "at index " << i;
+        }
+
+        kernels.int16_samples.remap_xsimd(samples.data(), remapped.data(), size, dmin, mmult,
+                                          Log10Accuracy::Exact);
+        kernels.int16_samples.remap_xsimd_u8(samples.data(), remappedU8.data(), size, dmin, mmult,
+                                             Log10Accuracy::Exact);
+        for(size_t i = 0; i < size; i++) {
+            ASSERT_NEAR(goldSamples[i], remapped[i], 1e-2f) << "at index " << i;
+            ASSERT_EQ(goldSamplesU8[i], remappedU8[i]) << "at index " << i;
+        }
+    }
+}
+
+TEST(Sum, HalfPrecisionInputs) {
+    using sum_detail::Isa;
+
+    const size_t size = 200003;
+
+    // Reference decode of IEEE half, normals and subnormals
+    auto halfToFloat = [](uint16_t h) {
+        const int exponent = (h >> 10) & 0x1f;
+        const int mantissa = h & 0x3ff;
+        const float magnitude = exponent == 0 ? std::ldexp(static_cast<float>(mantissa), -24)
+                                              : std::ldexp(static_cast<float>(mantissa | 0x400), exponent - 25);
+        return (h & 0x8000) ? -magnitude : magnitude;
+    };
+
+    std::mt19937 gen(9);
+    std::uniform_int_distribution<int> exponentDis(0, 30);
+    std::uniform_int_distribution<int> bitsDis(0, 0xffff);
+    std::uniform_real_distribution<> dis(-100.f, 100.f);
+
+    std::vector<Float16> halves(size);
+    std::vector<float> halvesWidened(size);
+    std::vector<BFloat16> bf16(size);
+    std::vector<float> bf16Widened(size);
+    for(size_t i = 0; i < size; i++) {
+        // Every finite half, subnormals included
+        const int bits = bitsDis(gen);
+        halves[i].bits = static_cast<uint16_t>((bits & 0x83ff) | (exponentDis(gen) << 10));
+        halvesWidened[i] = halfToFloat(halves[i].bits);
+
+        const float value = dis(gen);
+        bf16[i].bits = static_cast<uint16_t>(std::bit_cast<uint32_t>(value) >> 16);
+        bf16Widened[i] = std::bit_cast<float>(static_cast<uint32_t>(bf16[i].bits) << 16);
+    }
+
+    constexpr int dmin = 60;
+    constexpr int mmult = 40;
+
+    std::vector<float> goldHalves(size), goldBf16(size);
+    std::vector<uint8_t> goldHalvesU8(size), goldBf16U8(size);
+    remap_avx2_xsimd_into(halvesWidened, goldHalves, dmin, mmult);
+    remap_avx2_xsimd_into(bf16Widened, goldBf16, dmin, mmult);
+    remap_avx2_xsimd_u8_into(halvesWidened, goldHalvesU8, dmin, mmult);
+    remap_avx2_xsimd_u8_into(bf16Widened, goldBf16U8, dmin, mmult);
+
+    double halfSum = 0.0, bf16Sum = 0.0;
+    for(size_t i = 0; i < size; i++) {
+        halfSum += halvesWidened[i];
+        bf16Sum += bf16Widened[i];
+    }
+
+    for(const auto isa : {Isa::SSE42, Isa::AVX2, Isa::AVX512}) {
+        if(!sum_detail::isa_supported(isa)) {
+            continue;
+        }
+
+        const auto& kernels = sum_detail::kernels_for(isa);
+        SCOPED_TRACE(kernels.name);
+
+        EXPECT_NEAR(halfSum, kernels.sum_float16(halves.data(), size), 1e-6 * size);
+        EXPECT_NEAR(bf16Sum, kernels.sum_bfloat16(bf16.data(), size), 1e-6 * size);
+        EXPECT_NEAR(_sum_avx2_xsimd_omp(halvesWidened.data(), size),
+                    kernels.float16_samples.sum_xsimd(halves.data(), size), 1e-6 * size);
+        EXPECT_NEAR(_sum_avx2_xsimd_omp(bf16Widened.data(), size),
+                    kernels.bfloat16_samples.sum_xsimd(bf16.data(), size), 1e-6 * size);
+
+        std::vector<float> remapped(size);
+        std::vector<uint8_t> remappedU8(size);
+
+        kernels.float16_samples.remap_xsimd(halves.data(), remapped.data(), size, dmin, mmult,
+                                            Log10Accuracy::Exact);
+        kernels.float16_samples.remap_xsimd_u8(halves.data(), remappedU8.data(), size, dmin, mmult,
+                                               Log10Accuracy::Exact);
+        for(size_t i = 0; i < size; i++) {
+            ASSERT_NEAR(goldHalves[i], remapped[i], 1e-2f) << "at index " << i;
+            ASSERT_NEAR(goldHalvesU8[i], remappedU8[i], 1) << "at index " << i;
+        }
+
+        kernels.bfloat16_samples.remap_xsimd(bf16.data(), remapped.data(), size, dmin, mmult,
+                                             Log10Accuracy::Exact);
+        kernels.bfloat16_samples.remap_xsimd_u8(bf16.data(), remappedU8.data(), size, dmin, mmult,
+                                                Log10Accuracy::Exact);
+        for(size_t i = 0; i < size; i++) {
+            ASSERT_NEAR(goldBf16[i], remapped[i], 1e-2f) << "at index " << i;
+            ASSERT_NEAR(goldBf16U8[i], remappedU8[i], 1) << "at index " << i;
+        }
+    }
+}
+
+TEST(Sum, StreamRemapMatchesInMemory) {
+    // Not a multiple of the tile or of any register width
+    const size_t size = 1000003;
+
+    std::mt19937 gen(10);
+    std::uniform_real_distribution<> dis(-10.f, 10.f);
+
+    std::vector<float> data(size);
+    for(auto& x : data) {
+        x = dis(gen);
+    }
+
+    const std::string inPath = ::testing::TempDir() + "stream_remap_in.bin";
+    const std::string outPath = ::testing::TempDir() + "stream_remap_out.bin";
+    std::ofstream(inPath, std::ios::binary).write(reinterpret_cast<const char*>(data.data()),
+                                                  size * sizeof(float));
 
-    delete [] nonVectorRemap;
-    delete [] vectorRemap;
-    delete [] xsimd_vectorRemap;
+    constexpr int dmin = 60;
+    constexpr int mmult = 40;
+
+    std::vector<float> gold(size);
+    std::vector<uint8_t> goldU8(size);
+    remap_avx2_xsimd_into(data, gold, dmin, mmult);
+    remap_avx2_xsimd_u8_into(data, goldU8, dmin, mmult);
+
+    // A 256 KB budget streams the 4 MB frame in a few dozen tiles
+    StreamRemapOptions options{dmin, mmult};
+    options.tileBytes = 256 << 10;
+
+    const auto result = stream_remap_file(inPath, outPath, StreamOutput::Float32, options);
+    EXPECT_EQ(size, result.count);
+    EXPECT_GT(result.tiles, 10u);
+    EXPECT_NEAR(_sum_avx2_xsimd_omp(data.data(), size) / size, result.mean, 1e-9);
+
+    std::vector<float> remapped(size);
+    std::ifstream(outPath, std::ios::binary).read(reinterpret_cast<char*>(remapped.data()), size * sizeof(float));
+    for(size_t i = 0; i < size; i++) {
+        ASSERT_NEAR(gold[i], remapped[i], 1e-3f) << "at index " << i;
+    }
+
+    stream_remap_file(inPath, outPath, StreamOutput::UInt8, options);
+    std::vector<uint8_t> remappedU8(size);
+    std::ifstream(outPath, std::ios::binary).read(reinterpret_cast<char*>(remappedU8.data()), size);
+    for(size_t i = 0; i < size; i++) {
+        ASSERT_NEAR(goldU8[i], remappedU8[i], 1) << "at index " << i;
+    }
+
+    std::remove(inPath.c_str());
+    EXPECT_THROW(stream_remap_file(inPath, outPath, StreamOutput::UInt8, options), std::system_error);
+    std::remove(outPath.c_str());
+}
+
+TEST(Sum, BatchRemapPipeline) {
+    std::mt19937 gen(11);
+    std::uniform_real_distribution<> dis(-10.f, 10.f);
+
+    // Uneven sizes so the ring buffers have to grow and get reused
+    const std::vector<size_t> sizes = {100003, 4096, 250000, 17, 100003, 0, 180001};
+
+    std::vector<std::vector<float>> frames;
+    std::vector<BatchRemapJob> jobs;
+    for(size_t f = 0; f < sizes.size(); f++) {
+        std::vector<float> frame(sizes[f]);
+        for(auto& x : frame) {
+            x = dis(gen);
+        }
+
+        const std::string base = ::testing::TempDir() + "batch_remap_" + std::to_string(f);
+        std::ofstream(base + ".in", std::ios::binary).write(reinterpret_cast<const char*>(frame.data()),
+                                                            frame.size() * sizeof(float));
+        jobs.push_back({base + ".in", base + ".out"});
+        frames.push_back(std::move(frame));
+    }
+
+    constexpr int dmin = 60;
+    constexpr int mmult = 40;
+
+    for(const auto format : {StreamOutput::UInt8, StreamOutput::Float32}) {
+        BatchRemapOptions options{dmin, mmult};
+        options.format = format;
+        options.depth = 2;
+
+        const auto report = batch_remap_files(jobs, options);
+        EXPECT_EQ(sizes.size(), report.frames);
+        std::cout << "read " << report.read.occupancy << ", compute " << report.compute.occupancy
+                  << ", write " << report.write.occupancy << " of " << report.wallSeconds << " s" << std::endl;
+
+        for(size_t f = 0; f < frames.size(); f++) {
+            const size_t size = frames[f].size();
+            std::ifstream result(jobs[f].outPath, std::ios::binary);
+            if(format == StreamOutput::UInt8) {
+                std::vector<uint8_t> gold(size), remapped(size);
+                remap_avx2_xsimd_u8_into(frames[f], gold, dmin, mmult);
+                result.read(reinterpret_cast<char*>(remapped.data()), size);
+                EXPECT_EQ(gold, remapped) << "frame " << f;
+            } else {
+                std::vector<float> gold(size), remapped(size);
+                remap_avx2_xsimd_into(frames[f], gold, dmin, mmult);
+                result.read(reinterpret_cast<char*>(remapped.data()), size * sizeof(float));
+                EXPECT_EQ(gold, remapped) << "frame " << f;
+            }
+        }
+    }
+
+    // A missing input surfaces as the exception, not a hang
+    std::remove(jobs[3].inPath.c_str());
+    EXPECT_THROW(batch_remap_files(jobs, BatchRemapOptions{dmin, mmult}), std::system_error);
+
+    for(const auto& job : jobs) {
+        std::remove(job.inPath.c_str());
+        std::remove(job.outPath.c_str());
+    }
+}
+
+TEST(Sum, WorkPoolMatchesOpenMP) {
+    // A few frames in flight at once, sizes that leave a partial last chunk
+    const std::vector<size_t> sizes = {1000003, 4 * kPoolChunk, 100, 0, 2000000};
+
+    std::mt19937 gen(12);
+    std::uniform_real_distribution<> dis(-10.f, 10.f);
+
+    std::vector<std::vector<float>> frames;
+    for(size_t size : sizes) {
+        std::vector<float> frame(size);
+        for(auto& x : frame) {
+            x = dis(gen);
+        }
+        frames.push_back(std::move(frame));
+    }
+
+    constexpr int dmin = 60;
+    constexpr int mmult = 40;
+
+    for(unsigned threads : {1u, 3u}) {
+        WorkPool pool(threads);
+        ASSERT_EQ(threads, pool.size());
+
+        std::vector<std::vector<float>> remapped;
+        std::vector<std::vector<uint8_t>> remappedU8;
+        std::vector<std::future<void>> pending;
+        std::vector<std::future<double>> sums;
+        for(const auto& frame : frames) {
+            remapped.emplace_back(frame.size());
+            remappedU8.emplace_back(frame.size());
+            pending.push_back(remap_xsimd_async(pool, frame, remapped.back(), dmin, mmult));
+            pending.push_back(remap_xsimd_u8_async(pool, frame, remappedU8.back(), dmin, mmult));
+            sums.push_back(sum_xsimd_async(pool, frame));
+        }
+        for(auto& p : pending) {
+            p.get();
+        }
+
+        for(size_t f = 0; f < frames.size(); f++) {
+            const auto& frame = frames[f];
+            std::vector<float> mutableFrame(frame);
+            EXPECT_NEAR(_sum_avx2_xsimd_omp(mutableFrame.data(), frame.size()), sums[f].get(), 1e-9 * frame.size());
+
+            std::vector<float> gold(frame.size());
+            std::vector<uint8_t> goldU8(frame.size());
+            remap_avx2_xsimd_into(frame, gold, dmin, mmult);
+            remap_avx2_xsimd_u8_into(frame, goldU8, dmin, mmult);
+            for(size_t i = 0; i < frame.size(); i++) {
+                ASSERT_NEAR(gold[i], remapped[f][i], 1e-4f) << "frame " << f << " at index " << i;
+                ASSERT_NEAR(goldU8[i], remappedU8[f][i], 1) << "frame " << f << " at index " << i;
+            }
+        }
+    }
+
+    // Back-to-back calls on a pool against the OpenMP version
+    const auto& frame = frames[0];
+    std::vector<float> out(frame.size());
+    WorkPool pool;
+    Stopwatch sw;
+
+    sw.start();
+    for(int i = 0; i < 50; i++) {
+        remap_xsimd_async(pool, frame, out, dmin, mmult).get();
+    }
+    sw.stop();
+    std::cout << "WorkPool (" << pool.size() << " workers) 50 remaps: " << sw.elapsed() << " s" << std::endl;
+
+    sw.start();
+    for(int i = 0; i < 50; i++) {
+        remap_avx2_xsimd_into(frame, out, dmin, mmult);
+    }
+    sw.stop();
+    std::cout << "OpenMP 50 remaps: " << sw.elapsed() << " s" << std::endl;
+}
+
+TEST(Sum, RemapperTemporalClipLevels) {
+    const size_t size = 300007;
+    constexpr int dmin = 60;
+    constexpr int mmult = 40;
+
+    std::mt19937 gen(13);
+    std::uniform_real_distribution<> dis(-10.f, 10.f);
+
+    // A scene that brightens frame by frame
+    std::vector<std::vector<float>> frames(6, std::vector<float>(size));
+    for(size_t f = 0; f < frames.size(); f++) {
+        for(auto& x : frames[f]) {
+            x = dis(gen) * (1.0 + 0.2 * f);
+        }
+    }
+
+    auto frameMean = [&](const std::vector<float>& frame) {
+        std::vector<float> copy(frame);
+        return _sum_avx2_xsimd_omp(copy.data(), size) / size;
+    };
+
+    std::vector<float> remapped(size), gold(size);
+    std::vector<uint8_t> remappedU8(size), goldU8(size);
+
+    // Exact mode is the two-pass remap, frame for frame
+    Remapper exact({dmin, mmult, RemapMode::Exact});
+    for(const auto& frame : frames) {
+        exact.remap(frame, remapped);
+        remap_avx2_xsimd_into(frame, gold, dmin, mmult);
+        EXPECT_EQ(gold, remapped);
+        EXPECT_NEAR(frameMean(frame), exact.mean(), 1e-9);
+    }
+
+    // Temporal mode: exact on the first frame, then the smoothed history
+    const double smoothing = 0.5;
+    Remapper temporal({dmin, mmult, RemapMode::Temporal, smoothing});
+    double expectedMean = 0.0;
+    for(size_t f = 0; f < frames.size(); f++) {
+        temporal.remap_u8(frames[f], remappedU8);
+        if(f == 0) {
+            remap_avx2_xsimd_u8_into(frames[f], goldU8, dmin, mmult);
+            expectedMean = frameMean(frames[f]);
+        } else {
+            remap_avx2_xsimd_u8_with_mean_into(frames[f], goldU8, expectedMean, dmin, mmult);
+            expectedMean += smoothing * (frameMean(frames[f]) - expectedMean);
+        }
+        for(size_t i = 0; i < size; i++) {
+            ASSERT_NEAR(goldU8[i], remappedU8[i], 1) << "frame " << f << " at index " << i;
+        }
+        EXPECT_NEAR(expectedMean, temporal.mean(), 1e-6 * expectedMean);
+    }
+    EXPECT_FLOAT_EQ(0.8f * temporal.mean(), temporal.clip_low());
+
+    // In place, and reset() goes back to an exact first frame
+    temporal.reset();
+    std::vector<float> inplace(frames[3]);
+    temporal.remap(inplace, inplace);
+    remap_avx2_xsimd_into(frames[3], gold, dmin, mmult);
+    for(size_t i = 0; i < size; i++) {
+        ASSERT_NEAR(gold[i], inplace[i], 1e-4f) << "at index " << i;
+    }
+}
+
+TEST(Sum, RoiRemapMatchesCopiedOut) {
+    using sum_detail::Isa;
+
+    // A padded image, and a window that starts and ends mid-register
+    const size_t pitch = 1037;
+    const size_t rows = 411;
+    const Roi roi{13, 27, 517, 300};
+    const size_t outPitch = 523;
+
+    std::mt19937 gen(14);
+    std::uniform_real_distribution<> dis(-10.f, 10.f);
+
+    std::vector<float> image(pitch * rows);
+    for(auto& x : image) {
+        x = dis(gen);
+    }
+
+    std::vector<float> dense(roi.width * roi.height);
+    for(size_t r = 0; r < roi.height; r++) {
+        std::copy_n(&image[(roi.y + r) * pitch + roi.x], roi.width, &dense[r * roi.width]);
+    }
+
+    constexpr int dmin = 60;
+    constexpr int mmult = 40;
+
+    std::vector<float> gold(dense.size());
+    std::vector<uint8_t> goldU8(dense.size());
+    remap_avx2_xsimd_into(dense, gold, dmin, mmult);
+    remap_avx2_xsimd_u8_into(dense, goldU8, dmin, mmult);
+
+    for(const auto isa : {Isa::SSE42, Isa::AVX2, Isa::AVX512}) {
+        if(!sum_detail::isa_supported(isa)) {
+            continue;
+        }
+
+        const auto& kernels = sum_detail::kernels_for(isa);
+        SCOPED_TRACE(kernels.name);
+
+        const float* first = &image[roi.y * pitch + roi.x];
+        EXPECT_NEAR(_sum_avx2_xsimd_omp(dense.data(), dense.size()),
+                    kernels.roi_abs_sum(first, pitch, roi.width, roi.height), 1e-9 * dense.size());
+
+        // Sentinels in the output padding must survive the masked stores
+        std::vector<float> remapped(outPitch * roi.height, -1.f);
+        std::vector<uint8_t> remappedU8(outPitch * roi.height, 7);
+        kernels.remap_roi(first, pitch, remapped.data(), outPitch, roi.width, roi.height, dmin, mmult,
+                          Log10Accuracy::Exact);
+        kernels.remap_roi_u8(first, pitch, remappedU8.data(), outPitch, roi.width, roi.height, dmin, mmult,
+                             Log10Accuracy::Exact);
+
+        for(size_t r = 0; r < roi.height; r++) {
+            for(size_t c = 0; c < outPitch; c++) {
+                if(c < roi.width) {
+                    ASSERT_NEAR(gold[r * roi.width + c], remapped[r * outPitch + c], 1e-4f) << r << ", " << c;
+                    ASSERT_NEAR(goldU8[r * roi.width + c], remappedU8[r * outPitch + c], 1) << r << ", " << c;
+                } else {
+                    ASSERT_EQ(-1.f, remapped[r * outPitch + c]) << r << ", " << c;
+                    ASSERT_EQ(7, remappedU8[r * outPitch + c]) << r << ", " << c;
+                }
+            }
+        }
+    }
+
+    // And through the public entry point
+    std::vector<float> remapped(roi.width * roi.height);
+    remap_avx2_xsimd_roi_into(image.data(), pitch, roi, remapped.data(), roi.width, dmin, mmult);
+    for(size_t i = 0; i < remapped.size(); i++) {
+        ASSERT_NEAR(gold[i], remapped[i], 1e-4f) << "at index " << i;
+    }
+}
+
+TEST(Sum, DecimateRemapPyramid) {
+    using sum_detail::Isa;
+
+    // Odd sizes, so every level drops an edge row or column somewhere
+    const size_t rows = 517;
+    const size_t cols = 1003;
+    const size_t levels = 4;
+
+    std::mt19937 gen(15);
+    std::uniform_real_distribution<> dis(-10.f, 10.f);
+
+    std::vector<float> frame(rows * cols);
+    for(auto& x : frame) {
+        x = dis(gen);
+    }
+
+    constexpr int dmin = 60;
+    constexpr int mmult = 40;
+
+    for(const auto mode : {PoolMode::Box, PoolMode::Max}) {
+        // Reference: pool |x| straight from the frame, then remap with the
+        // mean of the covered input
+        const size_t coveredRows = rows / 2 * 2;
+        const size_t coveredCols = cols / 2 * 2;
+        double covered = 0.0;
+        for(size_t r = 0; r < coveredRows; r++) {
+            for(size_t c = 0; c < coveredCols; c++) {
+                covered += std::abs(frame[r * cols + c]);
+            }
+        }
+        const double mean = covered / (coveredRows * coveredCols);
+
+        std::vector<std::vector<float>> gold(levels);
+        for(size_t k = 0; k < levels; k++) {
+            const size_t f = size_t{2} << k;
+            const size_t outRows = rows / f, outCols = cols / f;
+            std::vector<float> pooled(outRows * outCols);
+            for(size_t r = 0; r < outRows; r++) {
+                for(size_t c = 0; c < outCols; c++) {
+                    double acc = 0.0;
+                    for(size_t i = 0; i < f; i++) {
+                        for(size_t j = 0; j < f; j++) {
+                            const double x = std::abs(frame[(r * f + i) * cols + c * f + j]);
+                            acc = mode == PoolMode::Max ? std::max(acc, x) : acc + x / (f * f);
+                        }
+                    }
+                    pooled[r * outCols + c] = acc;
+                }
+            }
+            gold[k].resize(pooled.size());
+            remap_avx2_xsimd_with_mean_into(pooled, gold[k], mean, dmin, mmult);
+        }
+
+        for(const auto isa : {Isa::SSE42, Isa::AVX2, Isa::AVX512}) {
+            if(!sum_detail::isa_supported(isa)) {
+                continue;
+            }
+
+            const auto& kernels = sum_detail::kernels_for(isa);
+            SCOPED_TRACE(kernels.name);
+
+            std::vector<std::vector<float>> pyramid(levels);
+            float* levelOut[sum_detail::kMaxPyramidLevels] = {};
+            for(size_t k = 0; k < levels; k++) {
+                pyramid[k].resize(gold[k].size());
+                levelOut[k] = pyramid[k].data();
+            }
+            kernels.pyramid_remap(frame.data(), rows, cols, levels, mode, levelOut, dmin, mmult,
+                                  Log10Accuracy::Exact);
+
+            for(size_t k = 0; k < levels; k++) {
+                for(size_t i = 0; i < gold[k].size(); i++) {
+                    ASSERT_NEAR(gold[k][i], pyramid[k][i], 1e-3f) << "level " << k << " at index " << i;
+                }
+            }
+        }
+
+        // A single 8x preview keeps only the last level
+        std::vector<float> preview((rows / 8) * (cols / 8));
+        decimate_remap_into(frame, rows, cols, 8, mode, preview, dmin, mmult);
+        for(size_t i = 0; i < preview.size(); i++) {
+            ASSERT_NEAR(gold[2][i], preview[i], 1e-3f) << "at index " << i;
+        }
+
+        const auto pyramid = remap_pyramid(frame, rows, cols, levels, mode, dmin, mmult);
+        ASSERT_EQ(levels, pyramid.size());
+        EXPECT_EQ(gold[3].size(), pyramid[3].size());
+    }
+
+    // Factor 1 is the plain remap, anything but a power of two up to 2^16 throws
+    std::vector<float> same(frame.size()), plain(frame.size());
+    decimate_remap_into(frame, rows, cols, 1, PoolMode::Box, same, dmin, mmult);
+    remap_avx2_xsimd_into(frame, plain, dmin, mmult);
+    EXPECT_EQ(plain, same);
+    std::vector<float> none;
+    EXPECT_THROW(decimate_remap_into(frame, rows, cols, 0, PoolMode::Box, none, dmin, mmult), std::invalid_argument);
+    EXPECT_THROW(decimate_remap_into(frame, rows, cols, 3, PoolMode::Box, none, dmin, mmult), std::invalid_argument);
+    EXPECT_THROW(decimate_remap_into(frame, rows, cols, size_t{1} << 17, PoolMode::Box, none, dmin, mmult),
+                 std::invalid_argument);
+
+    // The preview against a full resolution remap of a bigger frame
+    const size_t bigRows = 4096, bigCols = 4096;
+    std::vector<float> big(bigRows * bigCols);
+    for(auto& x : big) {
+        x = dis(gen);
+    }
+    std::vector<float> full(big.size()), preview((bigRows / 4) * (bigCols / 4));
+    Stopwatch sw;
+
+    sw.start();
+    remap_avx2_xsimd_into(big, full, dmin, mmult);
+    sw.stop();
+    std::cout << "Full resolution remap: " << sw.elapsed() << " s" << std::endl;
+
+    sw.start();
+    decimate_remap_into(big, bigRows, bigCols, 4, PoolMode::Box, preview, dmin, mmult);
+    sw.stop();
+    std::cout << "4x box preview: " << sw.elapsed() << " s" << std::endl;
+}
+
+TEST(Sum, FilterRemapMatchesTwoPasses) {
+    using sum_detail::Isa;
+
+    std::mt19937 gen(16);
+    std::uniform_real_distribution<> dis(-10.f, 10.f);
+
+    constexpr int dmin = 60;
+    constexpr int mmult = 40;
+
+    struct Case {
+        size_t rows, cols, window;
+    };
+    // More rows than a stripe, odd widths, and a window wider than the frame
+    for(const auto [rows, cols, window] : {Case{203, 157, 7}, Case{70, 301, 1}, Case{45, 5, 9}, Case{1, 33, 3}}) {
+        SCOPED_TRACE(std::to_string(rows) + "x" + std::to_string(cols) + " window " + std::to_string(window));
+
+        std::vector<float> frame(rows * cols);
+        for(auto& x : frame) {
+            x = dis(gen);
+        }
+
+        // Reference: filter into a temporary frame, then remap it with the
+        // mean of the unfiltered |x|
+        const long radius = window / 2;
+        std::vector<float> filtered(frame.size());
+        for(long r = 0; r < static_cast<long>(rows); r++) {
+            for(long c = 0; c < static_cast<long>(cols); c++) {
+                double acc = 0.0;
+                size_t count = 0;
+                for(long y = std::max(0l, r - radius); y <= std::min<long>(rows - 1, r + radius); y++) {
+                    for(long x = std::max(0l, c - radius); x <= std::min<long>(cols - 1, c + radius); x++) {
+                        acc += std::abs(frame[y * cols + x]);
+                        count++;
+                    }
+                }
+                filtered[r * cols + c] = acc / count;
+            }
+        }
+        std::vector<float> mutableFrame(frame);
+        const double mean = _sum_avx2_xsimd_omp(mutableFrame.data(), frame.size()) / frame.size();
+        std::vector<float> gold(frame.size());
+        std::vector<uint8_t> goldU8(frame.size());
+        remap_avx2_xsimd_with_mean_into(filtered, gold, mean, dmin, mmult);
+        remap_avx2_xsimd_u8_with_mean_into(filtered, goldU8, mean, dmin, mmult);
+
+        for(const auto isa : {Isa::SSE42, Isa::AVX2, Isa::AVX512}) {
+            if(!sum_detail::isa_supported(isa)) {
+                continue;
+            }
+
+            const auto& kernels = sum_detail::kernels_for(isa);
+            SCOPED_TRACE(kernels.name);
+
+            std::vector<float> remapped(frame.size());
+            std::vector<uint8_t> remappedU8(frame.size());
+            kernels.filter_remap(frame.data(), rows, cols, window, remapped.data(), dmin, mmult,
+                                 Log10Accuracy::Exact);
+            kernels.filter_remap_u8(frame.data(), rows, cols, window, remappedU8.data(), dmin, mmult,
+                                    Log10Accuracy::Exact);
+            for(size_t i = 0; i < frame.size(); i++) {
+                ASSERT_NEAR(gold[i], remapped[i], 1e-3f) << "at index " << i;
+                ASSERT_NEAR(goldU8[i], remappedU8[i], 1) << "at index " << i;
+            }
+        }
+    }
+}
+
+TEST(Sum, RowAndColumnReductions) {
+    using sum_detail::Isa;
+
+    std::mt19937 gen(17);
+    std::uniform_real_distribution<> dis(-10.f, 10.f);
+
+    for(const auto& [rows, cols] : {std::pair<size_t, size_t>{1031, 779}, {3, 64}, {17, 1}, {1, 200}}) {
+        SCOPED_TRACE(std::to_string(rows) + "x" + std::to_string(cols));
+
+        std::vector<float> frame(rows * cols);
+        for(auto& x : frame) {
+            x = dis(gen);
+        }
+
+        std::vector<double> goldRows(rows, 0.0), goldCols(cols, 0.0);
+        for(size_t r = 0; r < rows; r++) {
+            for(size_t c = 0; c < cols; c++) {
+                goldRows[r] += frame[r * cols + c];
+                goldCols[c] += frame[r * cols + c];
+            }
+        }
+
+        for(const auto isa : {Isa::SSE42, Isa::AVX2, Isa::AVX512}) {
+            if(!sum_detail::isa_supported(isa)) {
+                continue;
+            }
+
+            const auto& kernels = sum_detail::kernels_for(isa);
+            SCOPED_TRACE(kernels.name);
+
+            std::vector<double> rowSums(rows), colSums(cols);
+            kernels.reduce_rows(frame.data(), rows, cols, rowSums.data());
+            kernels.reduce_cols(frame.data(), rows, cols, colSums.data());
+            for(size_t r = 0; r < rows; r++) {
+                ASSERT_NEAR(goldRows[r], rowSums[r], 1e-9 * cols) << "row " << r;
+            }
+            for(size_t c = 0; c < cols; c++) {
+                ASSERT_NEAR(goldCols[c], colSums[c], 1e-9 * rows) << "column " << c;
+            }
+        }
+
+        std::vector<double> colMeans(cols);
+        reduce_cols(frame, rows, cols, colMeans, AxisStat::Mean);
+        EXPECT_NEAR(goldCols[0] / rows, colMeans[0], 1e-9);
+    }
+
+    // Thread count must not matter beyond rounding
+    const size_t rows = 2000, cols = 3000;
+    std::vector<float> frame(rows * cols);
+    for(auto& x : frame) {
+        x = dis(gen);
+    }
+    std::vector<double> one(cols), many(cols);
+    const int threads = omp_get_max_threads();
+    omp_set_num_threads(1);
+    reduce_cols(frame, rows, cols, one);
+    omp_set_num_threads(4);
+    reduce_cols(frame, rows, cols, many);
+    omp_set_num_threads(threads);
+    for(size_t c = 0; c < cols; c++) {
+        ASSERT_NEAR(one[c], many[c], 1e-9) << "column " << c;
+    }
+
+    Stopwatch sw;
+    sw.start();
+    reduce_cols(frame, rows, cols, many);
+    sw.stop();
+    std::cout << "reduce_cols of " << rows << "x" << cols << ": " << sw.elapsed() << " s" << std::endl;
+}
+
+TEST(Sum, NumaAwareModeKeepsResults) {
+    const auto& nodes = numa_topology().nodeCpus;
+    ASSERT_FALSE(nodes.empty());
+    for(const auto& cpus : nodes) {
+        EXPECT_FALSE(cpus.empty());
+    }
+
+    const int rows = 1000;
+    const int cols = 1001;
+    std::vector<float> frame(rows * cols);
+    std::mt19937 gen(18);
+    std::uniform_real_distribution<> dis(-10.f, 10.f);
+    for(auto& x : frame) {
+        x = dis(gen);
+    }
+
+    const auto plain = remap_avx2_scalar_log10(frame.data(), 60, 40, rows, cols);
+
+    cpu_set_t before;
+    CPU_ZERO(&before);
+    sched_getaffinity(0, sizeof(before), &before);
+
+    sum_set_numa_aware(true);
+    const auto placed = remap_avx2_scalar_log10(frame.data(), 60, 40, rows, cols);
+    cpu_set_t during;
+    CPU_ZERO(&during);
+    sched_getaffinity(0, sizeof(during), &during);
+    sum_set_numa_aware(false);
+    cpu_set_t after;
+    CPU_ZERO(&after);
+    sched_getaffinity(0, sizeof(after), &after);
+
+    // The caller's own thread is pinned to node 0 while it lasts, and gets its
+    // mask back after
+    cpu_set_t node0;
+    CPU_ZERO(&node0);
+    for(int cpu : nodes[0]) {
+        CPU_SET(cpu, &node0);
+    }
+    EXPECT_TRUE(CPU_EQUAL(&node0, &during));
+    EXPECT_TRUE(CPU_EQUAL(&before, &after));
+
+    // Moving a buffer's pages keeps what is in it, odd ends and all
+    AlignedBuffer<float> block(frame.size());
+    std::copy(frame.begin(), frame.end(), block.begin());
+    numa_place(block.data() + 3, (frame.size() - 5) * sizeof(float));
+    for(size_t i = 0; i < frame.size(); i++) {
+        ASSERT_EQ(frame[i], block[i]) << "at index " << i;
+    }
+
+    for(size_t i = 0; i < frame.size(); i++) {
+        ASSERT_EQ(plain[i], placed[i]) << "at index " << i;
+    }
+}
+
+TEST(Sum, AlignedBufferPoolReuse) {
+    buffer_pool::trim();
+    EXPECT_EQ(0u, buffer_pool::cached_bytes());
+
+    // Small blocks from the heap, big ones mapped for huge pages
+    for(const size_t size : {size_t{16}, size_t{1000}, size_t{3} << 20}) {
+        SCOPED_TRACE(size);
+        const float* first = nullptr;
+        {
+            AlignedBuffer<float> buffer(size);
+            first = buffer.data();
+            EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(first) % 64);
+            std::fill(buffer.begin(), buffer.end(), 1.f);
+        }
+        EXPECT_GT(buffer_pool::cached_bytes(), 0u);
+
+        // Anything in the same size class gets the block back
+        AlignedBuffer<float> again(size - 1);
+        EXPECT_EQ(first, again.data());
+
+        AlignedBuffer<float> moved(std::move(again));
+        EXPECT_EQ(first, moved.data());
+        EXPECT_TRUE(again.empty());
+    }
+
+    // A remap in a frame loop reuses the last frame's output
+    std::vector<float> frame(640 * 480, 2.f);
+    const float* last = remap_avx2_xsimd(frame.data(), 60, 40, 480, 640).data();
+    const auto remapped = remap_avx2_xsimd(frame.data(), 60, 40, 480, 640);
+    EXPECT_EQ(last, remapped.data());
+    EXPECT_EQ(frame.size(), remapped.size());
+
+    buffer_pool::trim();
+    EXPECT_EQ(0u, buffer_pool::cached_bytes());
+}
+
+TEST(Sum, PerfStopwatchCountsOrDegrades) {
+    std::vector<float> frame(1 << 22, 1.5f);
+    // Warm up, so the OpenMP team exists before the counters are opened
+    _sum_avx2_xsimd_omp(frame.data(), frame.size());
+
+    PerfStopwatch watch;
+    watch.start();
+    const double sum = _sum_avx2_xsimd_omp(frame.data(), frame.size());
+    watch.stop();
+    EXPECT_DOUBLE_EQ(1.5 * frame.size(), sum);
+
+    const PerfCounts counts = watch.counts();
+    EXPECT_GT(counts.seconds, 0.0);
+    if(!watch.available()) {
+        EXPECT_FALSE(watch.unavailable_reason().empty());
+        EXPECT_FALSE(counts.ipc());
+    } else if(counts.instructions) {
+        // At least a load and an add per vector of the frame
+        EXPECT_GT(*counts.instructions, frame.size() / 16);
+    }
+
+    std::cout << "Abs-sum of " << frame.size() << " floats: ";
+    watch.report(std::cout, frame.size());
+
+    // The report leaves the caller's formatting alone
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1);
+    watch.report(out, frame.size());
+    EXPECT_EQ(1, out.precision());
+    EXPECT_TRUE(out.flags() & std::ios::fixed);
+}
+
+TEST(Sum, TraceSpansAndHistograms) {
+    trace::clear();
+    trace::set_enabled(true);
+
+    std::vector<float> frame(1 << 18, -3.f);
+    std::vector<float> out(frame.size());
+    constexpr int frames = 20;
+    for(int i = 0; i < frames; i++) {
+        remap_avx2_xsimd_into(frame, out, 60, 40);
+    }
+    {
+        WorkPool pool(2);
+        remap_xsimd_async(pool, frame, out, 60, 40).get();
+    }
+
+    // What a span costs, enabled, with nothing inside it
+    static const trace::Region empty("test_empty");
+    constexpr int spans = 100000;
+    Stopwatch watch;
+    watch.start();
+    for(int i = 0; i < spans; i++) {
+        trace::Span span(empty);
+    }
+    watch.stop();
+    const double spanNs = watch.elapsed() / spans * 1e9;
+    std::cout << "One empty span: " << spanNs << " ns\n";
+    EXPECT_LT(spanNs, 1000.0);
+
+    trace::set_enabled(false);
+    {
+        // Disabled spans are not recorded
+        trace::Span span(empty);
+    }
+
+    std::map<std::string, trace::LatencySummary> byName;
+    for(const auto& summary : trace::latency_summary()) {
+        EXPECT_LE(summary.p50, summary.p99);
+        EXPECT_LE(summary.p99, summary.p999);
+        EXPECT_LE(summary.p999, static_cast<double>(summary.max));
+        byName[summary.name] = summary;
+    }
+    ASSERT_TRUE(byName.contains("remap"));
+    EXPECT_EQ(static_cast<uint64_t>(frames), byName["remap"].count);
+    EXPECT_EQ(static_cast<uint64_t>(spans), byName["test_empty"].count);
+    EXPECT_EQ(frame.size() / kPoolChunk, byName["pool_remap_chunk"].count);
+
+    // Names are escaped in the JSON
+    static const trace::Region awkward("say \"hi\"\\now\t");
+    trace::set_enabled(true);
+    {
+        trace::Span span(awkward);
+    }
+    trace::set_enabled(false);
+
+    std::ostringstream json;
+    trace::write_chrome_trace(json);
+    EXPECT_EQ(0u, json.str().rfind("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", 0));
+    EXPECT_NE(std::string::npos, json.str().find("\"name\":\"pool_sum_chunk\",\"ph\":\"X\""));
+    EXPECT_NE(std::string::npos, json.str().find(R"("name":"say \"hi\"\\now\u0009","ph")"));
+
+    trace::clear();
+    EXPECT_TRUE(trace::latency_summary().empty());
+
+    // Clearing and dumping while another thread records: only the spans
+    // after the last clear are left, and no event is read half-written
+    trace::set_enabled(true);
+    std::atomic<bool> stop{false};
+    std::thread writer([&] {
+        while(!stop.load()) {
+            trace::Span span(empty);
+        }
+    });
+    for(int i = 0; i < 50; i++) {
+        std::ostringstream dump;
+        trace::write_chrome_trace(dump);
+        EXPECT_TRUE(dump.str().ends_with("\n]}\n"));
+        trace::clear();
+    }
+    stop = true;
+    writer.join();
+    trace::clear();
+    for(int i = 0; i < 3; i++) {
+        trace::Span span(empty);
+    }
+    trace::set_enabled(false);
+    const auto summaries = trace::latency_summary();
+    ASSERT_EQ(1u, summaries.size());
+    EXPECT_EQ(3u, summaries[0].count);
+    trace::clear();
+}
+
+TEST(Sum, ParallelReduceSquaresAndDot) {
+    using sum_detail::Isa;
+
+    // Odd sizes so the block, register and element tails all run
+    for(const size_t size : {size_t{0}, size_t{5}, size_t{1003}, size_t{1} << 20 | 77}) {
+        SCOPED_TRACE(size);
+        std::mt19937 gen(24);
+        std::uniform_real_distribution<float> dis(-4.f, 4.f);
+        std::vector<float> a(size), b(size);
+        for(size_t i = 0; i < size; i++) {
+            a[i] = dis(gen);
+            b[i] = dis(gen);
+        }
+
+        double sum = 0.0, absSum = 0.0, squares = 0.0, dot = 0.0;
+        for(size_t i = 0; i < size; i++) {
+            sum += a[i];
+            absSum += std::abs(a[i]);
+            squares += static_cast<double>(a[i] * a[i]);
+            dot += static_cast<double>(a[i] * b[i]);
+        }
+
+        const double tolerance = 1e-9 * (absSum + squares + 1.0);
+        for(const auto isa : {Isa::SSE42, Isa::AVX2, Isa::AVX512}) {
+            if(!sum_detail::isa_supported(isa)) {
+                continue;
+            }
+            const auto& kernels = sum_detail::kernels_for(isa);
+            SCOPED_TRACE(kernels.name);
+
+            EXPECT_NEAR(sum, kernels.sum_avx2(a.data(), size), tolerance);
+            EXPECT_NEAR(sum, kernels.sum_avx2_omp(a.data(), size), tolerance);
+            EXPECT_NEAR(absSum, kernels.sum_avx2_xsimd_omp(a.data(), size), tolerance);
+            EXPECT_NEAR(squares, kernels.sum_squares(a.data(), size), tolerance);
+            EXPECT_NEAR(dot, kernels.dot(a.data(), b.data(), size), tolerance);
+        }
+
+        EXPECT_NEAR(squares, _sum_squares(a), tolerance);
+        EXPECT_NEAR(dot, _dot(a, b), tolerance);
+    }
 }
 
 int main(int argc, char **argv) {
@@ -1,4 +1,8 @@
 #include "algo.hpp"
+#include "utils/Stopwatch.hpp"
+
+#include <format> // std::format
+#include <random> // std::mt19937
 
 /**
  * @brief Goes through a linked list and deletes the memory allocated for
@@ -76,6 +80,83 @@ void Algo::printLinkedList(Node* linkedList) {
     }
 }
 
+/**
+ * @brief Times Algo::sort against std::sort on copies of the same input and
+ * checks they agree. Best of a few runs, so page faults on the first copy
+ * don't count against whichever goes first.
+ */
+template<typename T> requires OnlyNumeric<T>
+void benchmarkSort(const char* name, const std::vector<T>& input) {
+    constexpr int runs = 3;
+    double bestAlgo = 1e30;
+    double bestStd = 1e30;
+    std::vector<T> algoSorted;
+    std::vector<T> stdSorted;
+
+    for(int run = 0; run < runs; run++) {
+        Stopwatch watch;
+
+        algoSorted = input;
+        watch.start();
+        Algo::sort(algoSorted);
+        watch.stop();
+        bestAlgo = std::min(bestAlgo, watch.elapsed());
+
+        stdSorted = input;
+        watch.start();
+        std::sort(stdSorted.begin(), stdSorted.end());
+        watch.stop();
+        bestStd = std::min(bestStd, watch.elapsed());
+    }
+
+    std::println("{:<24} Algo::sort {:8.2f} ms   std::sort {:8.2f} ms   {:5.2f}x{}", name, bestAlgo * 1e3,
+                 bestStd * 1e3, bestStd / bestAlgo, algoSorted == stdSorted ? "" : "   MISMATCH");
+}
+
+template<typename T> requires OnlyNumeric<T>
+void benchmarkSorts(const char* type, size_t size) {
+    std::mt19937 gen(25);
+    std::vector<T> input(size);
+
+    for(auto& val : input) {
+        if constexpr(std::same_as<T, int>) {
+            val = static_cast<int>(gen());
+        } else {
+            val = std::uniform_real_distribution<T>(-1e6, 1e6)(gen);
+        }
+    }
+    benchmarkSort(std::format("{} random", type).c_str(), input);
+
+    std::vector<T> sorted(input);
+    std::sort(sorted.begin(), sorted.end());
+    benchmarkSort(std::format("{} sorted", type).c_str(), sorted);
+
+    std::vector<T> reversed(sorted.rbegin(), sorted.rend());
+    benchmarkSort(std::format("{} reversed", type).c_str(), reversed);
+
+    // Sorted but for one element in a hundred
+    for(size_t i = 0; i < size; i += 100) {
+        sorted[i] = input[i];
+    }
+    benchmarkSort(std::format("{} nearly sorted", type).c_str(), sorted);
+
+    // Lots of duplicates
+    for(auto& val : input) {
+        val = static_cast<T>(gen() % 100);
+    }
+    benchmarkSort(std::format("{} few unique", type).c_str(), input);
+
+    // Infinities at both ends, which the small-sort padding must stay above
+    if constexpr(std::floating_point<T>) {
+        constexpr T inf = std::numeric_limits<T>::infinity();
+        benchmarkSort(std::format("{} {{inf, 1, 2}}", type).c_str(), std::vector<T>{inf, 1, 2});
+        for(size_t i = 0; i < size; i += 7) {
+            input[i] = (i / 7) % 2 ? inf : -inf;
+        }
+        benchmarkSort(std::format("{} with infinities", type).c_str(), input);
+    }
+}
+
 int main() {
     Node* ll = Algo::generateLinkedList(3);
     Algo::printLinkedList(ll);
@@ -137,4 +218,12 @@ int main() {
             std::println("{}", val);
         }
     }
+
+    {
+        constexpr size_t size = 4'000'000;
+        std::println("Algo::sort against std::sort, {} elements...", size);
+        benchmarkSorts<int>("int", size);
+        benchmarkSorts<float>("float", size);
+        benchmarkSorts<double>("double", size);
+    }
 }
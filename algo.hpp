@@ -1,6 +1,11 @@
 #pragma once
 
+#include <algorithm> // std::make_heap, std::sort_heap, std::reverse
+#include <bit> // std::bit_width
+#include <cstddef> // std::size_t
+#include <immintrin.h> // AVX2 intrinsics for the small-sort network
 #include <type_traits> // std::same_as
+#include <utility> // std::pair, std::swap
 #include <vector> // std::vector
 #include <limits> // std::numeric_limits
 #include <print> // std::print, C++23 feature
@@ -39,6 +44,10 @@ public:
 
     template<typename T> requires OnlyNumeric<T>
     static std::vector<T> mergeSort(std::vector<T>& toBeSorted);
+
+    // The one to use for real data, see the comment on the definition
+    template<typename T> requires OnlyNumeric<T>
+    static void sort(std::vector<T>& toBeSorted);
 };
 
 /**
@@ -188,4 +197,475 @@ std::vector<T> Algo::mergeSort(std::vector<T>& toBeSorted) {
     splitMerge(toBeSorted, 0, toBeSorted.size(), arrCopy);
 
     return toBeSorted;
-}
\ No newline at end of file
+}
+
+namespace sort_detail {
+
+// Partitions this small or smaller go to the small sort
+constexpr std::ptrdiff_t kSmallSort = 16;
+// Above this the pivot is a ninther, a median of three medians of three
+constexpr std::ptrdiff_t kNinther = 128;
+// Elements a partial insertion sort may move before it gives up
+constexpr std::size_t kPartialInsertionLimit = 8;
+// Elements classified at a time by the branchless partition
+constexpr std::ptrdiff_t kBlock = 64;
+
+template<typename T>
+void sort2(T* a, T* b) {
+    if(*b < *a) {
+        std::swap(*a, *b);
+    }
+}
+
+template<typename T>
+void sort3(T* a, T* b, T* c) {
+    sort2(a, b);
+    sort2(b, c);
+    sort2(a, b);
+}
+
+template<typename T>
+void insertionSort(T* begin, T* end) {
+    for(T* cur = begin + 1; cur < end; cur++) {
+        T tmp = *cur;
+        T* sift = cur;
+        while(sift != begin && tmp < *(sift - 1)) {
+            *sift = *(sift - 1);
+            sift--;
+        }
+        *sift = tmp;
+    }
+}
+
+// An insertion sort that gives up once it has moved more than a few
+// elements. True if [begin, end) ended up sorted
+template<typename T>
+bool partialInsertionSort(T* begin, T* end) {
+    std::size_t moved = 0;
+    for(T* cur = begin + 1; cur < end; cur++) {
+        if(*cur < *(cur - 1)) {
+            T tmp = *cur;
+            T* sift = cur;
+            do {
+                *sift = *(sift - 1);
+                sift--;
+            } while(sift != begin && tmp < *(sift - 1));
+            *sift = tmp;
+            moved += cur - sift;
+        }
+        if(moved > kPartialInsertionLimit) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * AVX2 bitonic network for up to 16 ints or floats, two registers of 8. Each
+ * step compare-exchanges every lane with lane ^ j: min and max of the
+ * register and its permutation, blended so the lane gets the one its place
+ * in the network calls for. No branches, so random data costs the same as
+ * sorted. Only called after __builtin_cpu_supports("avx2").
+ */
+struct NetworkStep {
+    int partner[8];
+    int takeMax[8];
+};
+
+// Lane i of step (k, j) keeps the min when it is the lower lane of an
+// ascending block, or the upper lane of a descending one
+constexpr NetworkStep makeStep(int k, int j) {
+    NetworkStep step{};
+    for(int i = 0; i < 8; i++) {
+        step.partner[i] = i ^ j;
+        const bool ascending = (i & k) == 0;
+        const bool lower = (i & j) == 0;
+        step.takeMax[i] = ascending == lower ? 0 : -1;
+    }
+    return step;
+}
+
+// Sorts within each register: k is the bitonic block size, 8 sorts all lanes
+constexpr NetworkStep kSortSteps[] = {
+    makeStep(2, 1), makeStep(4, 2), makeStep(4, 1),
+    makeStep(8, 4), makeStep(8, 2), makeStep(8, 1),
+};
+// Sorts a bitonic register ascending
+constexpr NetworkStep kMergeSteps[] = {makeStep(8, 4), makeStep(8, 2), makeStep(8, 1)};
+
+__attribute__((target("avx2"))) inline __m256 networkStep(__m256 v, const NetworkStep& step) {
+    const __m256i partner = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(step.partner));
+    const __m256 takeMax = _mm256_castsi256_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(step.takeMax)));
+    const __m256 other = _mm256_permutevar8x32_ps(v, partner);
+    return _mm256_blendv_ps(_mm256_min_ps(v, other), _mm256_max_ps(v, other), takeMax);
+}
+
+__attribute__((target("avx2"))) inline __m256i networkStep(__m256i v, const NetworkStep& step) {
+    const __m256i partner = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(step.partner));
+    const __m256i takeMax = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(step.takeMax));
+    const __m256i other = _mm256_permutevar8x32_epi32(v, partner);
+    return _mm256_blendv_epi8(_mm256_min_epi32(v, other), _mm256_max_epi32(v, other), takeMax);
+}
+
+__attribute__((target("avx2"))) inline __m256 reverseLanes(__m256 v) {
+    return _mm256_permutevar8x32_ps(v, _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+}
+
+__attribute__((target("avx2"))) inline __m256i reverseLanes(__m256i v) {
+    return _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+}
+
+__attribute__((target("avx2"))) inline __m256 loadLanes(const float* p) { return _mm256_load_ps(p); }
+__attribute__((target("avx2"))) inline __m256i loadLanes(const int* p) {
+    return _mm256_load_si256(reinterpret_cast<const __m256i*>(p));
+}
+__attribute__((target("avx2"))) inline void storeLanes(float* p, __m256 v) { _mm256_store_ps(p, v); }
+__attribute__((target("avx2"))) inline void storeLanes(int* p, __m256i v) {
+    _mm256_store_si256(reinterpret_cast<__m256i*>(p), v);
+}
+
+__attribute__((target("avx2"))) inline __m256 minLanes(__m256 a, __m256 b) { return _mm256_min_ps(a, b); }
+__attribute__((target("avx2"))) inline __m256 maxLanes(__m256 a, __m256 b) { return _mm256_max_ps(a, b); }
+__attribute__((target("avx2"))) inline __m256i minLanes(__m256i a, __m256i b) { return _mm256_min_epi32(a, b); }
+__attribute__((target("avx2"))) inline __m256i maxLanes(__m256i a, __m256i b) { return _mm256_max_epi32(a, b); }
+
+template<typename T>
+__attribute__((target("avx2"))) void networkSort16(T* data, std::ptrdiff_t n) {
+    // Padded with the largest value, which sorts to the end and is dropped.
+    // For float that is +inf, max() would sort below an infinity in the input
+    constexpr T padding =
+        std::numeric_limits<T>::has_infinity ? std::numeric_limits<T>::infinity() : std::numeric_limits<T>::max();
+    alignas(32) T lanes[16];
+    for(std::ptrdiff_t i = 0; i < 16; i++) {
+        lanes[i] = i < n ? data[i] : padding;
+    }
+
+    auto a = loadLanes(lanes);
+    auto b = loadLanes(lanes + 8);
+
+    for(const NetworkStep& step : kSortSteps) {
+        a = networkStep(a, step);
+        b = networkStep(b, step);
+    }
+
+    // a and b reversed make one bitonic sequence: the lane-wise min is the
+    // bottom eight, the max the top eight, each bitonic
+    b = reverseLanes(b);
+    auto lo = minLanes(a, b);
+    auto hi = maxLanes(a, b);
+    for(const NetworkStep& step : kMergeSteps) {
+        lo = networkStep(lo, step);
+        hi = networkStep(hi, step);
+    }
+
+    storeLanes(lanes, lo);
+    storeLanes(lanes + 8, hi);
+    std::copy_n(lanes, n, data);
+}
+
+inline bool hasAvx2() {
+    static const bool supported = [] {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") != 0;
+    }();
+    return supported;
+}
+
+// Up to kSmallSort elements. The network needs 32-bit lanes, doubles and
+// CPUs without AVX2 get an insertion sort
+template<typename T>
+void smallSort(T* begin, T* end) {
+    if constexpr(std::same_as<T, int> || std::same_as<T, float>) {
+        if(hasAvx2()) {
+            networkSort16(begin, end - begin);
+            return;
+        }
+    }
+    insertionSort(begin, end);
+}
+
+template<typename T>
+void swapOffsets(T* first, T* last, const unsigned char* offsetsL, const unsigned char* offsetsR,
+                 std::size_t num, bool useSwaps) {
+    if(useSwaps) {
+        // Equal counts need swaps, the cyclic version below would need one
+        // more element on one side
+        for(std::size_t i = 0; i < num; i++) {
+            std::swap(first[offsetsL[i]], *(last - offsetsR[i]));
+        }
+    } else if(num > 0) {
+        T* l = first + offsetsL[0];
+        T* r = last - offsetsR[0];
+        T tmp = *l;
+        *l = *r;
+        for(std::size_t i = 1; i < num; i++) {
+            l = first + offsetsL[i];
+            *r = *l;
+            r = last - offsetsR[i];
+            *l = *r;
+        }
+        *r = tmp;
+    }
+}
+
+/**
+ * @brief Partitions [begin, end) around the pivot *begin into < pivot and
+ * >= pivot. Elements are classified a block at a time into offset buffers
+ * with no data-dependent branch, then the misplaced ones are swapped in
+ * bulk, so random data does not pay for a mispredict per element.
+ *
+ * @return The pivot's final place, and whether nothing had to move
+ */
+template<typename T>
+std::pair<T*, bool> partitionRight(T* begin, T* end) {
+    const T pivot = *begin;
+    T* first = begin;
+    T* last = end;
+
+    // The median-of-3 left an element >= pivot at the end to stop this
+    while(*++first < pivot);
+
+    if(first - 1 == begin) {
+        while(first < last && !(*--last < pivot));
+    } else {
+        while(!(*--last < pivot));
+    }
+
+    const bool alreadyPartitioned = first >= last;
+    if(!alreadyPartitioned) {
+        std::swap(*first, *last);
+        first++;
+
+        unsigned char offsetsL[kBlock];
+        unsigned char offsetsR[kBlock];
+        std::size_t numL = 0, numR = 0, startL = 0, startR = 0;
+
+        while(last - first > 2 * kBlock) {
+            if(numL == 0) {
+                startL = 0;
+                for(std::ptrdiff_t i = 0; i < kBlock; i++) {
+                    offsetsL[numL] = static_cast<unsigned char>(i);
+                    numL += !(first[i] < pivot);
+                }
+            }
+            if(numR == 0) {
+                startR = 0;
+                for(std::ptrdiff_t i = 1; i <= kBlock; i++) {
+                    offsetsR[numR] = static_cast<unsigned char>(i);
+                    numR += *(last - i) < pivot;
+                }
+            }
+
+            const std::size_t num = std::min(numL, numR);
+            swapOffsets(first, last, offsetsL + startL, offsetsR + startR, num, numL == numR);
+            numL -= num;
+            numR -= num;
+            startL += num;
+            startR += num;
+            if(numL == 0) {
+                first += kBlock;
+            }
+            if(numR == 0) {
+                last -= kBlock;
+            }
+        }
+
+        // Fewer than three blocks left, one of which may be half done
+        std::size_t sizeL = 0, sizeR = 0;
+        const std::size_t unknown = static_cast<std::size_t>(last - first) - ((numR || numL) ? kBlock : 0);
+        if(numR) {
+            sizeL = unknown;
+            sizeR = kBlock;
+        } else if(numL) {
+            sizeL = kBlock;
+            sizeR = unknown;
+        } else {
+            sizeL = unknown / 2;
+            sizeR = unknown - sizeL;
+        }
+
+        if(unknown && !numL) {
+            startL = 0;
+            for(std::size_t i = 0; i < sizeL; i++) {
+                offsetsL[numL] = static_cast<unsigned char>(i);
+                numL += !(first[i] < pivot);
+            }
+        }
+        if(unknown && !numR) {
+            startR = 0;
+            for(std::size_t i = 1; i <= sizeR; i++) {
+                offsetsR[numR] = static_cast<unsigned char>(i);
+                numR += *(last - i) < pivot;
+            }
+        }
+
+        const std::size_t num = std::min(numL, numR);
+        swapOffsets(first, last, offsetsL + startL, offsetsR + startR, num, numL == numR);
+        numL -= num;
+        numR -= num;
+        startL += num;
+        startR += num;
+        if(numL == 0) {
+            first += sizeL;
+        }
+        if(numR == 0) {
+            last -= sizeR;
+        }
+
+        // Whatever is left over sits on one side only, move it across the gap
+        if(numL) {
+            while(numL--) {
+                std::swap(first[offsetsL[startL + numL]], *--last);
+            }
+            first = last;
+        }
+        if(numR) {
+            while(numR--) {
+                std::swap(*(last - offsetsR[startR + numR]), *first);
+                first++;
+            }
+            last = first;
+        }
+    }
+
+    T* pivotPos = first - 1;
+    *begin = *pivotPos;
+    *pivotPos = pivot;
+    return {pivotPos, alreadyPartitioned};
+}
+
+// Puts every element equal to the pivot *begin on its left side. Used when
+// the pivot equals the one before this partition, so the left side is all
+// equal and done
+template<typename T>
+T* partitionLeft(T* begin, T* end) {
+    const T pivot = *begin;
+    T* first = begin;
+    T* last = end;
+
+    while(pivot < *--last);
+    if(last + 1 == end) {
+        while(first < last && !(pivot < *++first));
+    } else {
+        while(!(pivot < *++first));
+    }
+
+    while(first < last) {
+        std::swap(*first, *last);
+        while(pivot < *--last);
+        while(!(pivot < *++first));
+    }
+
+    *begin = *last;
+    *last = pivot;
+    return last;
+}
+
+// Swaps a few elements around to break up whatever pattern keeps giving us
+// bad pivots
+template<typename T>
+void breakPatterns(T* begin, T* end) {
+    const std::ptrdiff_t size = end - begin;
+    if(size < kSmallSort) {
+        return;
+    }
+    std::swap(*begin, begin[size / 4]);
+    std::swap(*(end - 1), *(end - size / 4));
+    if(size > kNinther) {
+        std::swap(begin[1], begin[size / 4 + 1]);
+        std::swap(begin[2], begin[size / 4 + 2]);
+        std::swap(*(end - 2), *(end - (size / 4 + 1)));
+        std::swap(*(end - 3), *(end - (size / 4 + 2)));
+    }
+}
+
+template<typename T>
+void pdqLoop(T* begin, T* end, int badAllowed, bool leftmost) {
+    while(true) {
+        const std::ptrdiff_t size = end - begin;
+        if(size <= kSmallSort) {
+            smallSort(begin, end);
+            return;
+        }
+
+        // Median of 3, or a ninther, moved to *begin
+        const std::ptrdiff_t half = size / 2;
+        if(size > kNinther) {
+            sort3(begin, begin + half, end - 1);
+            sort3(begin + 1, begin + (half - 1), end - 2);
+            sort3(begin + 2, begin + (half + 1), end - 3);
+            sort3(begin + (half - 1), begin + half, begin + (half + 1));
+            std::swap(*begin, begin[half]);
+        } else {
+            sort3(begin + half, begin, end - 1);
+        }
+
+        // The same pivot as the partition to our left: everything equal to it
+        // goes left and is already in place
+        if(!leftmost && !(*(begin - 1) < *begin)) {
+            begin = partitionLeft(begin, end) + 1;
+            continue;
+        }
+
+        const auto [pivotPos, alreadyPartitioned] = partitionRight(begin, end);
+        const std::ptrdiff_t sizeL = pivotPos - begin;
+        const std::ptrdiff_t sizeR = end - (pivotPos + 1);
+
+        if(sizeL < size / 8 || sizeR < size / 8) {
+            // Too many bad pivots in a row, heapsort keeps us O(n log n)
+            if(--badAllowed == 0) {
+                std::make_heap(begin, end);
+                std::sort_heap(begin, end);
+                return;
+            }
+            breakPatterns(begin, pivotPos);
+            breakPatterns(pivotPos + 1, end);
+        } else if(alreadyPartitioned && partialInsertionSort(begin, pivotPos) &&
+                  partialInsertionSort(pivotPos + 1, end)) {
+            // Probably sorted already, and the insertion sorts proved it
+            return;
+        }
+
+        // The left side recursively, the right side in this loop
+        pdqLoop(begin, pivotPos, badAllowed, leftmost);
+        begin = pivotPos + 1;
+        leftmost = false;
+    }
+}
+
+} // namespace sort_detail
+
+/**
+ * @brief Sorts ascending with pattern-defeating quicksort (pdqsort): an
+ * introsort that picks median-of-3 or ninther pivots, partitions without
+ * branching on the data, falls back to heapsort after repeated bad pivots
+ * and finishes partitions of 16 or fewer with an AVX2 sorting network when
+ * the CPU has AVX2. Input that is already sorted, or sorted in reverse, is
+ * spotted up front and costs one pass. Not stable. NaNs are not supported,
+ * as with std::sort.
+ *
+ * @tparam T required to be a numeric type
+ * @param toBeSorted The vector which we want sorted
+ */
+template<typename T> requires OnlyNumeric<T>
+void Algo::sort(std::vector<T>& toBeSorted) {
+    if(toBeSorted.size() < 2) {
+        return;
+    }
+
+    T* begin = toBeSorted.data();
+    T* end = begin + toBeSorted.size();
+
+    // One pass to catch sorted and reverse sorted input. Random input fails
+    // within a few elements, so this costs nothing there
+    if(std::is_sorted(begin, end)) {
+        return;
+    }
+    if(std::is_sorted(begin, end, [](const T& a, const T& b) { return b < a; })) {
+        std::reverse(begin, end);
+        return;
+    }
+
+    const int badAllowed = std::bit_width(toBeSorted.size());
+    sort_detail::pdqLoop(begin, end, badAllowed, true);
+}
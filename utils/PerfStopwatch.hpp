@@ -0,0 +1,263 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <dirent.h>
+#include <iomanip>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "Stopwatch.hpp"
+
+// Counts from one PerfStopwatch interval. A counter the kernel would not
+// give us is empty, the wall time is always there
+struct PerfCounts {
+    double seconds = 0.0;
+    std::optional<uint64_t> cycles;
+    std::optional<uint64_t> instructions;
+    std::optional<uint64_t> llcMisses;
+    std::optional<uint64_t> branchMisses;
+    // Summed time the cycles counter was running, over every thread counted
+    double runningSeconds = 0.0;
+
+    std::optional<double> ipc() const {
+        if (!cycles || !instructions || *cycles == 0) {
+            return std::nullopt;
+        }
+        return static_cast<double>(*instructions) / *cycles;
+    }
+
+    // Average clock while running, a drop here is throttling, not the code
+    std::optional<double> ghz() const {
+        if (!cycles || runningSeconds <= 0.0) {
+            return std::nullopt;
+        }
+        return *cycles / runningSeconds / 1e9;
+    }
+};
+
+/**
+ * A Stopwatch that also reads cycles, instructions, LLC misses and branch
+ * misses through perf_event_open, for telling a regression from cache
+ * misses apart from one from mispredicts or a frequency drop.
+ *
+ * Scope::Process counts every thread alive when the PerfStopwatch is made,
+ * so make it after the OpenMP team exists (after a warm-up call). Without
+ * counters (perf_event_paranoid, a container, a VM without a PMU) it is a
+ * plain Stopwatch and report() says why.
+ */
+class PerfStopwatch {
+public:
+    enum class Scope { Thread, Process };
+
+    explicit PerfStopwatch(Scope scope = Scope::Process) {
+        if (scope == Scope::Thread) {
+            open_group(0);
+        } else {
+            for (pid_t tid : process_threads()) {
+                open_group(tid);
+            }
+        }
+    }
+
+    ~PerfStopwatch() {
+        for (const Group& group : groups) {
+            for (int fd : group.fds) {
+                ::close(fd);
+            }
+        }
+    }
+
+    PerfStopwatch(const PerfStopwatch&) = delete;
+    PerfStopwatch& operator=(const PerfStopwatch&) = delete;
+
+    // True if at least one counter opened
+    bool available() const { return !groups.empty(); }
+    // Why the counters are missing, empty when they are all there
+    const std::string& unavailable_reason() const { return reason; }
+
+    void start() {
+        for (const Group& group : groups) {
+            ::ioctl(group.fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ::ioctl(group.fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+        watch.start();
+    }
+
+    void stop() {
+        watch.stop();
+        for (const Group& group : groups) {
+            ::ioctl(group.fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        }
+    }
+
+    void reset() {
+        watch.reset();
+    }
+
+    double elapsed() {
+        return watch.elapsed();
+    }
+
+    // The counts since start(), scaled up if the kernel had to multiplex
+    PerfCounts counts() {
+        PerfCounts result;
+        result.seconds = watch.elapsed();
+
+        for (const Group& group : groups) {
+            // nr, time_enabled, time_running, then one value per counter
+            uint64_t buffer[3 + kCounters] = {};
+            if (::read(group.fds[0], buffer, sizeof(buffer)) < static_cast<ssize_t>(3 * sizeof(uint64_t))) {
+                continue;
+            }
+            const uint64_t enabled = buffer[1];
+            const uint64_t running = buffer[2];
+            const double scale = running > 0 ? static_cast<double>(enabled) / running : 0.0;
+
+            for (size_t i = 0; i < group.counters.size() && i < buffer[0]; i++) {
+                const auto value = static_cast<uint64_t>(buffer[3 + i] * scale);
+                std::optional<uint64_t>& total = slot(result, group.counters[i]);
+                total = total.value_or(0) + value;
+                if (group.counters[i] == Counter::Cycles) {
+                    result.runningSeconds += running * 1e-9;
+                }
+            }
+        }
+        return result;
+    }
+
+    // Elapsed time, IPC, clock and misses per element, on one line. The
+    // stream's formatting is put back afterwards
+    void report(std::ostream& out, size_t elements) {
+        const PerfCounts c = counts();
+        const std::ios::fmtflags flags = out.flags();
+        const std::streamsize precision = out.precision();
+        out.unsetf(std::ios::floatfield);
+        out << std::setprecision(4) << c.seconds << " s";
+
+        if (const auto ipc = c.ipc()) {
+            out << ", IPC " << *ipc;
+        }
+        if (const auto ghz = c.ghz()) {
+            out << ", " << *ghz << " GHz";
+        }
+        const auto per_element = [&](const char* name, const std::optional<uint64_t>& count) {
+            if (count && elements > 0) {
+                out << ", " << name << "/elem " << static_cast<double>(*count) / elements;
+            }
+        };
+        per_element("LLC misses", c.llcMisses);
+        per_element("branch misses", c.branchMisses);
+
+        if (!reason.empty()) {
+            out << " (" << reason << ")";
+        }
+        out << "\n";
+        out.flags(flags);
+        out.precision(precision);
+    }
+
+private:
+    enum class Counter { Cycles, Instructions, LlcMisses, BranchMisses };
+    static constexpr size_t kCounters = 4;
+
+    struct Group {
+        std::vector<int> fds;
+        std::vector<Counter> counters;
+    };
+
+    static std::vector<pid_t> process_threads() {
+        std::vector<pid_t> tids;
+        if (DIR* dir = ::opendir("/proc/self/task")) {
+            while (const dirent* entry = ::readdir(dir)) {
+                if (entry->d_name[0] != '.') {
+                    tids.push_back(static_cast<pid_t>(std::stol(entry->d_name)));
+                }
+            }
+            ::closedir(dir);
+        }
+        if (tids.empty()) {
+            tids.push_back(0);
+        }
+        return tids;
+    }
+
+    static perf_event_attr attr_for(Counter counter) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        switch (counter) {
+        case Counter::Cycles:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case Counter::Instructions:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case Counter::LlcMisses:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        case Counter::BranchMisses:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+        }
+        return attr;
+    }
+
+    static std::optional<uint64_t>& slot(PerfCounts& counts, Counter counter) {
+        switch (counter) {
+        case Counter::Cycles:
+            return counts.cycles;
+        case Counter::Instructions:
+            return counts.instructions;
+        case Counter::LlcMisses:
+            return counts.llcMisses;
+        case Counter::BranchMisses:
+            break;
+        }
+        return counts.branchMisses;
+    }
+
+    // One group per thread, the first counter that opens leads it. A counter
+    // this CPU does not have is left out rather than failing the rest
+    void open_group(pid_t tid) {
+        Group group;
+        for (Counter counter : {Counter::Cycles, Counter::Instructions, Counter::LlcMisses, Counter::BranchMisses}) {
+            perf_event_attr attr = attr_for(counter);
+            const int leader = group.fds.empty() ? -1 : group.fds[0];
+            const int fd = static_cast<int>(::syscall(SYS_perf_event_open, &attr, tid, -1, leader, 0));
+            if (fd < 0) {
+                if (reason.empty()) {
+                    reason = std::string("perf_event_open: ") + std::strerror(errno);
+                }
+                continue;
+            }
+            group.fds.push_back(fd);
+            group.counters.push_back(counter);
+        }
+        if (!group.fds.empty()) {
+            groups.push_back(std::move(group));
+        }
+    }
+
+    Stopwatch watch;
+    std::vector<Group> groups;
+    std::string reason;
+};
@@ -0,0 +1,410 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/**
+ * Scoped tracing for the frame pipeline, cheap enough to leave on in
+ * production around per-frame stages and per-chunk work.
+ *
+ *   static const trace::Region kRemap("remap");
+ *   ...
+ *   trace::Span span(kRemap);
+ *
+ * A Span costs two clock reads and a few stores into memory only its thread
+ * writes: each thread has a ring of its last kRingEvents spans and an
+ * HDR-style latency histogram per region (32 buckets per power of two, so
+ * within ~3%). Nothing is shared between threads until a reader asks, and
+ * with tracing disabled a Span is one relaxed load. The clock reads are most
+ * of it, an enabled Span is two steady_clock::now() calls plus under 10 ns.
+ *
+ * latency_summary() merges the histograms into p50/p99/p999 per region and
+ * write_chrome_trace() dumps the rings as Chrome trace_event JSON, for
+ * chrome://tracing or ui.perfetto.dev. Both read while threads may still be
+ * writing: each ring slot carries the index of the event in it, written
+ * around the event like a seqlock, so a slot being overwritten mid-dump is
+ * skipped rather than read half-written. Spans finishing during a dump may
+ * be missed.
+ *
+ * clear() never writes another thread's log. It starts a new epoch, a thread
+ * drops what it has recorded the next time it records in the new epoch, and
+ * until then readers leave it out.
+ */
+
+namespace trace {
+
+constexpr size_t kMaxRegions = 256;
+constexpr size_t kRingEvents = size_t{1} << 15;
+
+namespace detail {
+
+inline std::atomic<bool> g_enabled{false};
+// Bumped by clear(), under the registry mutex
+inline std::atomic<uint64_t> g_epoch{0};
+
+inline uint64_t now_ns() {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+            .count());
+}
+
+// Buckets 0-31 are exact, then 32 per power of two
+class Histogram {
+public:
+    static constexpr size_t kSubBits = 5;
+    static constexpr size_t kSub = size_t{1} << kSubBits;
+    static constexpr size_t kBuckets = (64 - kSubBits + 1) * kSub;
+
+    static size_t bucket_of(uint64_t ns) {
+        if (ns < kSub) {
+            return static_cast<size_t>(ns);
+        }
+        const size_t exponent = static_cast<size_t>(std::bit_width(ns)) - 1;
+        const size_t sub = static_cast<size_t>(ns >> (exponent - kSubBits)) & (kSub - 1);
+        return (exponent - kSubBits + 1) * kSub + sub;
+    }
+
+    // The middle of a bucket's range
+    static double value_of(size_t bucket) {
+        if (bucket < kSub) {
+            return static_cast<double>(bucket);
+        }
+        const size_t exponent = bucket / kSub + kSubBits - 1;
+        const size_t sub = bucket % kSub;
+        const double width = static_cast<double>(uint64_t{1} << (exponent - kSubBits));
+        return static_cast<double>(kSub + sub) * width + width / 2;
+    }
+
+    // Only the owning thread records or resets, so no read-modify-write is
+    // needed
+    void record(uint64_t ns) {
+        auto& count = counts[bucket_of(ns)];
+        count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        if (ns > max.load(std::memory_order_relaxed)) {
+            max.store(ns, std::memory_order_relaxed);
+        }
+    }
+
+    void reset() {
+        for (auto& count : counts) {
+            count.store(0, std::memory_order_relaxed);
+        }
+        max.store(0, std::memory_order_relaxed);
+    }
+
+    std::array<std::atomic<uint64_t>, kBuckets> counts{};
+    std::atomic<uint64_t> max{0};
+};
+
+// sequence is the index of the event in the slot plus one, 0 while it is
+// being written
+struct Event {
+    std::atomic<uint64_t> sequence{0};
+    std::atomic<uint32_t> region{0};
+    std::atomic<uint64_t> start{0};
+    std::atomic<uint64_t> duration{0};
+};
+
+// Everything one thread has recorded. Kept alive by the registry after the
+// thread exits, so its spans still make it into a dump
+struct ThreadLog {
+    ThreadLog()
+        : tid(static_cast<uint64_t>(::syscall(SYS_gettid))), ring(kRingEvents),
+          epoch(g_epoch.load(std::memory_order_acquire)) {}
+
+    ~ThreadLog() {
+        for (auto& histogram : histograms) {
+            delete histogram.load(std::memory_order_relaxed);
+        }
+    }
+
+    void record(uint32_t region, uint64_t start, uint64_t duration) {
+        const uint64_t current = g_epoch.load(std::memory_order_acquire);
+        if (current != epoch.load(std::memory_order_relaxed)) {
+            reset(current);
+        }
+
+        const uint64_t index = head.load(std::memory_order_relaxed);
+        Event& event = ring[index % kRingEvents];
+        event.sequence.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        event.region.store(region, std::memory_order_relaxed);
+        event.start.store(start, std::memory_order_relaxed);
+        event.duration.store(duration, std::memory_order_relaxed);
+        event.sequence.store(index + 1, std::memory_order_release);
+        head.store(index + 1, std::memory_order_release);
+
+        Histogram* histogram = histograms[region].load(std::memory_order_relaxed);
+        if (!histogram) {
+            histogram = new Histogram();
+            histograms[region].store(histogram, std::memory_order_release);
+        }
+        histogram->record(duration);
+    }
+
+    // Event "index" if its slot still holds it, read the way record() writes
+    bool read(uint64_t index, uint32_t& region, uint64_t& start, uint64_t& duration) const {
+        const Event& event = ring[index % kRingEvents];
+        if (event.sequence.load(std::memory_order_acquire) != index + 1) {
+            return false;
+        }
+        region = event.region.load(std::memory_order_relaxed);
+        start = event.start.load(std::memory_order_relaxed);
+        duration = event.duration.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return event.sequence.load(std::memory_order_relaxed) == index + 1;
+    }
+
+    // Whether this log has caught up with the last clear(), readers skip it
+    // until it has
+    bool current() const {
+        return epoch.load(std::memory_order_acquire) == g_epoch.load(std::memory_order_relaxed);
+    }
+
+    const uint64_t tid;
+    std::vector<Event> ring;
+    std::atomic<uint64_t> head{0};
+    // The first event of this epoch, the ring keeps counting up across a clear
+    std::atomic<uint64_t> first{0};
+    std::array<std::atomic<Histogram*>, kMaxRegions> histograms{};
+
+private:
+    // Drops everything recorded before the clear() that started "current".
+    // Readers skip this log until the epoch store at the end
+    void reset(uint64_t current) {
+        first.store(head.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        for (auto& histogram : histograms) {
+            if (Histogram* h = histogram.load(std::memory_order_relaxed)) {
+                h->reset();
+            }
+        }
+        epoch.store(current, std::memory_order_release);
+    }
+
+    std::atomic<uint64_t> epoch;
+};
+
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::string> regions;
+    std::vector<std::shared_ptr<ThreadLog>> threads;
+};
+
+inline Registry& registry() {
+    static Registry instance;
+    return instance;
+}
+
+// "text" as a JSON string literal, quotes included
+inline void write_json_string(std::ostream& out, const std::string& text) {
+    static constexpr char kHex[] = "0123456789abcdef";
+    out << '"';
+    for (const char ch : text) {
+        const auto c = static_cast<unsigned char>(ch);
+        if (c == '"' || c == '\\') {
+            out << '\\' << ch;
+        } else if (c < 0x20) {
+            out << "\\u00" << kHex[c >> 4] << kHex[c & 0xf];
+        } else {
+            out << ch;
+        }
+    }
+    out << '"';
+}
+
+// The thread's log for the hot path. Constant-initialized, so reading it
+// skips the guard a thread_local with a constructor is checked through
+inline thread_local ThreadLog* t_log = nullptr;
+
+// The thread's own reference, so clear() can tell live threads from dead ones
+struct ThreadHandle {
+    ThreadHandle() : log(std::make_shared<ThreadLog>()) {
+        Registry& r = registry();
+        std::lock_guard lock(r.mutex);
+        r.threads.push_back(log);
+        t_log = log.get();
+    }
+
+    ~ThreadHandle() { t_log = nullptr; }
+
+    std::shared_ptr<ThreadLog> log;
+};
+
+inline ThreadLog& thread_log() {
+    if (ThreadLog* log = t_log) {
+        return *log;
+    }
+    thread_local ThreadHandle handle;
+    return *handle.log;
+}
+
+} // namespace detail
+
+inline void set_enabled(bool enabled) {
+    detail::g_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+inline bool enabled() {
+    return detail::g_enabled.load(std::memory_order_relaxed);
+}
+
+// A named thing to time. Make them once, as statics, not per Span
+class Region {
+public:
+    explicit Region(const char* name) {
+        detail::Registry& r = detail::registry();
+        std::lock_guard lock(r.mutex);
+        if (r.regions.size() == kMaxRegions) {
+            throw std::length_error("trace: more than kMaxRegions regions");
+        }
+        region_id = static_cast<uint32_t>(r.regions.size());
+        r.regions.emplace_back(name);
+    }
+
+    uint32_t id() const { return region_id; }
+
+private:
+    uint32_t region_id;
+};
+
+// Times its own lifetime as one span of a region
+class Span {
+public:
+    explicit Span(const Region& r) : region(r.id()), start(enabled() ? detail::now_ns() : 0) {}
+
+    ~Span() {
+        if (start != 0) {
+            detail::thread_log().record(region, start, detail::now_ns() - start);
+        }
+    }
+
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+
+private:
+    uint32_t region;
+    uint64_t start;
+};
+
+struct LatencySummary {
+    std::string name;
+    uint64_t count;
+    // Nanoseconds
+    double p50;
+    double p99;
+    double p999;
+    uint64_t max;
+};
+
+// Every region with at least one span, over all threads
+inline std::vector<LatencySummary> latency_summary() {
+    detail::Registry& r = detail::registry();
+    std::lock_guard lock(r.mutex);
+
+    std::vector<LatencySummary> summaries;
+    std::vector<uint64_t> merged(detail::Histogram::kBuckets);
+    for (size_t region = 0; region < r.regions.size(); region++) {
+        std::fill(merged.begin(), merged.end(), 0);
+        LatencySummary summary{r.regions[region], 0, 0.0, 0.0, 0.0, 0};
+
+        for (const auto& thread : r.threads) {
+            if (!thread->current()) {
+                continue;
+            }
+            const detail::Histogram* histogram = thread->histograms[region].load(std::memory_order_acquire);
+            if (!histogram) {
+                continue;
+            }
+            for (size_t b = 0; b < merged.size(); b++) {
+                const uint64_t n = histogram->counts[b].load(std::memory_order_relaxed);
+                merged[b] += n;
+                summary.count += n;
+            }
+            summary.max = std::max(summary.max, histogram->max.load(std::memory_order_relaxed));
+        }
+        if (summary.count == 0) {
+            continue;
+        }
+
+        // The smallest bucket holding at least q of the spans
+        const auto quantile = [&](double q) {
+            const auto rank = static_cast<uint64_t>(q * static_cast<double>(summary.count - 1)) + 1;
+            uint64_t seen = 0;
+            for (size_t b = 0; b < merged.size(); b++) {
+                seen += merged[b];
+                if (seen >= rank) {
+                    return std::min(detail::Histogram::value_of(b), static_cast<double>(summary.max));
+                }
+            }
+            return static_cast<double>(summary.max);
+        };
+        summary.p50 = quantile(0.5);
+        summary.p99 = quantile(0.99);
+        summary.p999 = quantile(0.999);
+        summaries.push_back(std::move(summary));
+    }
+    return summaries;
+}
+
+// The spans still in every thread's ring as Chrome trace_event JSON
+inline void write_chrome_trace(std::ostream& out) {
+    detail::Registry& r = detail::registry();
+    std::lock_guard lock(r.mutex);
+
+    const uint64_t pid = static_cast<uint64_t>(::getpid());
+    const std::ios::fmtflags flags = out.flags();
+    const std::streamsize precision = out.precision();
+    out << std::fixed << std::setprecision(3);
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    bool first = true;
+    for (const auto& thread : r.threads) {
+        if (!thread->current()) {
+            continue;
+        }
+        const uint64_t head = thread->head.load(std::memory_order_acquire);
+        const uint64_t begin = std::max(thread->first.load(std::memory_order_acquire),
+                                        head > kRingEvents ? head - kRingEvents : 0);
+        for (uint64_t i = begin; i < head; i++) {
+            uint32_t region;
+            uint64_t start, duration;
+            if (!thread->read(i, region, start, duration) || region >= r.regions.size()) {
+                continue;
+            }
+            out << (first ? "\n" : ",\n") << "{\"name\":";
+            detail::write_json_string(out, r.regions[region]);
+            // Microseconds, to the nanosecond
+            out << ",\"ph\":\"X\",\"pid\":" << pid << ",\"tid\":" << thread->tid << ",\"ts\":" << start / 1e3
+                << ",\"dur\":" << duration / 1e3 << "}";
+            first = false;
+        }
+    }
+    out << "\n]}\n";
+    out.flags(flags);
+    out.precision(precision);
+}
+
+// Forgets every span and histogram count, and the logs of threads that have
+// exited. The regions stay. Live threads drop their own logs the next time
+// they record, see the top of the file
+inline void clear() {
+    detail::Registry& r = detail::registry();
+    std::lock_guard lock(r.mutex);
+    std::erase_if(r.threads, [](const auto& thread) { return thread.use_count() == 1; });
+    detail::g_epoch.fetch_add(1, std::memory_order_acq_rel);
+}
+
+} // namespace trace